@@ -0,0 +1,778 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <cassert>
+
+#include <omp.h>
+#include <Eigen/Dense>
+
+#include "MeshHelper.h"
+#include "SIMDVoxelHelper.h"
+
+// CPU port of VoxelizationGS.glsl (Rauwendaal & Bailey, "Hybrid Computational Voxelization Using
+// the Graphics Pipeline"). It evaluates the same edge and plane tests as the shader, in the same
+// span-clipped loop order, so that both backends produce the same grid up to float rounding; the
+// grid layout matches glGetTexImage (x fastest).
+namespace cpuvoxh {
+	// Thin voxelization is when adjacent voxels are at least connected by vertices,
+	// fat voxelization is when adjacent voxels need to share at least a face
+	enum Thickness { THIN = 0, FAT = 1 };
+
+	// swizzle triangle vertices so that the dominant axis-aligned plane becomes the XY plane.
+	// axis is 0 for XYZ <-> YZX, 1 for XYZ <-> ZXY and 2 for no swizzle (same order as unswizzleLUT).
+	inline void swizzle_tri(Eigen::Vector3f &v0, Eigen::Vector3f &v1, Eigen::Vector3f &v2, Eigen::Vector3f &n, int &axis) {
+		n = (v1 - v0).cross(v2 - v1);
+		Eigen::Vector3f absN = n.cwiseAbs();
+
+		auto yzx = [](const Eigen::Vector3f &v) { return Eigen::Vector3f(v.y(), v.z(), v.x()); };
+		auto zxy = [](const Eigen::Vector3f &v) { return Eigen::Vector3f(v.z(), v.x(), v.y()); };
+
+		if (absN.x() >= absN.y() && absN.x() >= absN.z()) {
+			//X-direction dominant (YZ-plane)
+			v0 = yzx(v0); v1 = yzx(v1); v2 = yzx(v2); n = yzx(n);
+			axis = 0;
+		} else if (absN.y() >= absN.x() && absN.y() >= absN.z()) {
+			//Y-direction dominant (ZX-plane)
+			v0 = zxy(v0); v1 = zxy(v1); v2 = zxy(v2); n = zxy(n);
+			axis = 1;
+		} else {
+			//Z-direction dominant (XY-plane)
+			axis = 2;
+		}
+	}
+
+	// voxel coordinate of the grid frame in the swizzled frame of axis
+	inline Eigen::Vector3i swizzle(const Eigen::Vector3i &p, int axis) {
+		if (axis == 0)
+			return Eigen::Vector3i(p.y(), p.z(), p.x());
+		else if (axis == 1)
+			return Eigen::Vector3i(p.z(), p.x(), p.y());
+		return p;
+	}
+
+	// inverse of the swizzle, turns a voxel coordinate of the swizzled frame back into the grid frame
+	inline Eigen::Vector3i unswizzle(const Eigen::Vector3i &p, int axis) {
+		if (axis == 0)
+			return Eigen::Vector3i(p.z(), p.x(), p.y());
+		else if (axis == 1)
+			return Eigen::Vector3i(p.y(), p.z(), p.x());
+		return p;
+	}
+
+	inline float dot2(float ax, float ay, float bx, float by) {
+		return ax*bx + ay*by;
+	}
+
+	// runs up to this many cells are cheaper to test cell by cell than to clip (thin surfaces, small triangles)
+	const int MIN_CLIP_SPAN = 16;
+
+	// Narrows [lo, hi) to the cells passing an edge test whose value c + n*t is monotone in the stepped
+	// coordinate t (c is the value at t = 0). The crossing is solved analytically and then fixed up by
+	// evaluating the test itself, so the result is exactly what testing every cell would accept.
+	template <typename Test>
+	inline void clip_span(int &lo, int &hi, float n, float c, Test test) {
+		if (lo >= hi)
+			return;
+		if (n == 0) {
+			if (!test(lo))
+				hi = lo;
+			return;
+		}
+		// start guess, short spans are scanned from the end that passes first and skip the division
+		int t;
+		if (hi - lo <= MIN_CLIP_SPAN) {
+			t = n > 0 ? hi - 1 : lo;
+		} else {
+			float tf = -c/n;
+			t = tf >= lo ? (tf < hi - 1 ? (int)tf : hi - 1) : lo;
+		}
+		if (n > 0) {
+			// passes for t >= lo
+			if (test(t)) {
+				while (t > lo && test(t - 1))
+					t--;
+			} else {
+				do t++; while (t < hi && !test(t));
+			}
+			lo = t;
+		} else {
+			// passes for t < hi
+			if (test(t)) {
+				while (t < hi - 1 && test(t + 1))
+					t++;
+				t++;
+			} else {
+				do t--; while (t >= lo && !test(t));
+				t++;
+			}
+			hi = t;
+		}
+	}
+
+	// linear index step of each swizzled axis in the (unswizzled) grid
+	inline void swizzled_steps(int axis, const int voxelResolution[3], size_t step[3]) {
+		const size_t s[3] = {1, (size_t)voxelResolution[0], (size_t)voxelResolution[0]*voxelResolution[1]};
+		for (int k = 0; k < 3; k++) {
+			Eigen::Vector3i e = Eigen::Vector3i::Zero();
+			e[k] = 1;
+			Eigen::Vector3i q = unswizzle(e, axis);
+			step[k] = q.x()*s[0] + q.y()*s[1] + q.z()*s[2];
+		}
+	}
+
+
+	// voxel bounding box [lo, hi) of a triangle in voxel space, before clamping to the grid
+	inline void triangle_bounds(const Eigen::Vector3f &v0, const Eigen::Vector3f &v1, const Eigen::Vector3f &v2,
+			Eigen::Vector3i &lo, Eigen::Vector3i &hi) {
+		for (int i = 0; i < 3; i++) {
+			lo[i] = (int)std::floor(std::min(std::min(v0[i], v1[i]), v2[i]));
+			hi[i] = (int)std::ceil(std::max(std::max(v0[i], v1[i]), v2[i]));
+		}
+	}
+
+	// true when the voxel box [lo, hi) is a single cell that is already set, a triangle inside it cannot
+	// add anything. This skips most sub-voxel triangles of a dense scan at low dim before any setup.
+	// The cell lies in the clip box, so under voxelize_tiled only the calling thread ever writes it.
+	inline bool cell_already_set(const Eigen::Vector3i &lo, const Eigen::Vector3i &hi, const int voxelResolution[3], const uint8_t *image) {
+		if (hi - lo != Eigen::Vector3i::Ones())
+			return false;
+		return image[((size_t)lo.z()*voxelResolution[1] + lo.y())*voxelResolution[0] + lo.x()] != 0;
+	}
+
+	// voxelizes one triangle given in voxel space (unit cube scaled by the resolution), writing only
+	// the cells of the box [clipMin, clipMax) of the grid. Every cell is decided on its own, so the
+	// cells of a box are exactly those the unclipped triangle would set there.
+	inline void voxelize_triangle(Eigen::Vector3f v0, Eigen::Vector3f v1, Eigen::Vector3f v2, const int voxelResolution[3],
+			Thickness thickness, uint8_t *image, const Eigen::Vector3i &clipMin, const Eigen::Vector3i &clipMax) {
+		Eigen::Vector3i lo, hi;
+		triangle_bounds(v0, v1, v2, lo, hi);
+		lo = lo.cwiseMax(clipMin).cwiseMin(clipMax);
+		hi = hi.cwiseMax(clipMin).cwiseMin(clipMax);
+		if (cell_already_set(lo, hi, voxelResolution, image))
+			return;
+
+		Eigen::Vector3f n;
+		int axis;
+		swizzle_tri(v0, v1, v2, n, axis);
+		const Eigen::Vector3i minVoxIndex = swizzle(lo, axis), maxVoxIndex = swizzle(hi, axis);
+
+		Eigen::Vector3f e0 = v1 - v0;
+		Eigen::Vector3f e1 = v2 - v1;
+		Eigen::Vector3f e2 = v0 - v2;
+
+		//INward Facing edge normals XY, YZ, ZX (stored as [edge][component])
+		float n_xy[3][2], n_yz[3][2], n_zx[3][2];
+		const Eigen::Vector3f *e[3] = {&e0, &e1, &e2};
+		for (int i = 0; i < 3; i++) {
+			const Eigen::Vector3f &ei = *e[i];
+			n_xy[i][0] = n.z() >= 0 ? -ei.y() : ei.y();  n_xy[i][1] = n.z() >= 0 ? ei.x() : -ei.x();
+			n_yz[i][0] = n.x() >= 0 ? -ei.z() : ei.z();  n_yz[i][1] = n.x() >= 0 ? ei.y() : -ei.y();
+			n_zx[i][0] = n.y() >= 0 ? -ei.x() : ei.x();  n_zx[i][1] = n.y() >= 0 ? ei.z() : -ei.z();
+		}
+
+		const Eigen::Vector3f *v[3] = {&v0, &v1, &v2};
+		float d_xy[3], d_yz[3], d_zx[3];
+		for (int i = 0; i < 3; i++) {
+			const Eigen::Vector3f &vi = *v[i];
+			if (thickness == THIN) {
+				d_xy[i] = dot2(n_xy[i][0], n_xy[i][1], .5f - vi.x(), .5f - vi.y()) + 0.5f*std::max(std::abs(n_xy[i][0]), std::abs(n_xy[i][1]));
+				d_yz[i] = dot2(n_yz[i][0], n_yz[i][1], .5f - vi.y(), .5f - vi.z()) + 0.5f*std::max(std::abs(n_yz[i][0]), std::abs(n_yz[i][1]));
+				d_zx[i] = dot2(n_zx[i][0], n_zx[i][1], .5f - vi.z(), .5f - vi.x()) + 0.5f*std::max(std::abs(n_zx[i][0]), std::abs(n_zx[i][1]));
+			} else {
+				d_xy[i] = -dot2(n_xy[i][0], n_xy[i][1], vi.x(), vi.y()) + std::max(0.0f, n_xy[i][0]) + std::max(0.0f, n_xy[i][1]);
+				d_yz[i] = -dot2(n_yz[i][0], n_yz[i][1], vi.y(), vi.z()) + std::max(0.0f, n_yz[i][0]) + std::max(0.0f, n_yz[i][1]);
+				d_zx[i] = -dot2(n_zx[i][0], n_zx[i][1], vi.z(), vi.x()) + std::max(0.0f, n_zx[i][0]) + std::max(0.0f, n_zx[i][1]);
+			}
+		}
+
+		Eigen::Vector3f nProj = (n.z() < 0.0f) ? Eigen::Vector3f(-n) : n;
+
+		const float dTri = nProj.dot(v0);
+		const float dTriThin   = dTri - dot2(nProj.x(), nProj.y(), 0.5f, 0.5f);
+		const float dTriFatMin = dTri - std::max(nProj.x(), 0.0f) - std::max(nProj.y(), 0.0f);
+		const float dTriFatMax = dTri - std::min(nProj.x(), 0.0f) - std::min(nProj.y(), 0.0f);
+		const float dTriMin = thickness == THIN ? dTriThin : dTriFatMin;
+		const float dTriMax = thickness == THIN ? dTriThin : dTriFatMax;
+
+		const float nzInv = 1.0f / nProj.z();
+
+		size_t step[3];
+		swizzled_steps(axis, voxelResolution, step);
+
+		auto xy_test = [&](int i, int x, int y) { return d_xy[i] + dot2(n_xy[i][0], n_xy[i][1], x, y) >= 0; };
+		auto yz_test = [&](int i, int y, int z) { return d_yz[i] + dot2(n_yz[i][0], n_yz[i][1], y, z) >= 0; };
+		auto zx_test = [&](int i, int z, int x) { return d_zx[i] + dot2(n_zx[i][0], n_zx[i][1], z, x) >= 0; };
+
+		// z-range of the voxels the plane (thickened as per mode) passes through in column p.xy
+		auto z_range = [&](const Eigen::Vector3i &p, int &zMin, int &zMax) {
+			float dot_n_p = dot2(nProj.x(), nProj.y(), p.x(), p.y());
+			float zMinInt, zMaxInt;
+			if (thickness == THIN) {
+				zMinInt = (-dot_n_p + dTriThin)*nzInv;
+				zMaxInt = zMinInt;
+			} else {
+				zMinInt = (-dot_n_p + dTriFatMin)*nzInv;
+				zMaxInt = (-dot_n_p + dTriFatMax)*nzInv;
+			}
+			float zMinFloor = std::floor(zMinInt);
+			float zMaxCeil  = std::ceil(zMaxInt);
+
+			zMin = (int)zMinFloor - (int)(zMinFloor == zMinInt);
+			zMax = (int)zMaxCeil  + (int)(zMaxCeil  == zMaxInt);
+		};
+
+		// small triangles (the common case at low dim) are cheaper to test cell by cell, on 8 or 16 cells at once
+		if ((maxVoxIndex - minVoxIndex).maxCoeff() <= MIN_CLIP_SPAN) {
+			simdvoxh::CellSetup cells;
+			for (int i = 0; i < 3; i++) {
+				for (int k = 0; k < 2; k++) {
+					cells.n_xy[i][k] = n_xy[i][k];
+					cells.n_yz[i][k] = n_yz[i][k];
+					cells.n_zx[i][k] = n_zx[i][k];
+				}
+				cells.d_xy[i] = d_xy[i];
+				cells.d_yz[i] = d_yz[i];
+				cells.d_zx[i] = d_zx[i];
+				cells.min[i] = minVoxIndex[i];
+				cells.max[i] = maxVoxIndex[i];
+				cells.step[i] = step[i];
+			}
+			cells.nProj[0] = nProj.x();
+			cells.nProj[1] = nProj.y();
+			cells.dTriMin = dTriMin;
+			cells.dTriMax = dTriMax;
+			cells.nzInv = nzInv;
+			simdvoxh::voxelize_cells(cells, image);
+			return;
+		}
+
+		Eigen::Vector3i p;
+		int zMin, zMax;
+
+		// Every edge test is monotone along each axis, so instead of testing every cell the kernel clips
+		// spans: the y-interval of a column against the xy edges, then the z-interval of a cell against
+		// the zx edges (per column) and yz edges (per row). The values at t = 0 that seed clip_span are
+		// stepped incrementally; the tests themselves are evaluated as before, so the grid is unchanged.
+		float c_xy[3], c_zx[3], c_yz[3];
+		for (int i = 0; i < 3; i++) {
+			c_xy[i] = d_xy[i] + n_xy[i][0]*minVoxIndex.x();
+			c_zx[i] = d_zx[i] + n_zx[i][1]*minVoxIndex.x();
+		}
+
+		for (p.x() = minVoxIndex.x(); p.x() < maxVoxIndex.x(); p.x()++) {
+			int yLo = minVoxIndex.y(), yHi = maxVoxIndex.y();
+			int zxLo = minVoxIndex.z(), zxHi = maxVoxIndex.z();
+			for (int i = 0; i < 3; i++) {
+				clip_span(yLo, yHi, n_xy[i][1], c_xy[i], [&](int y) { return xy_test(i, p.x(), y); });
+				clip_span(zxLo, zxHi, n_zx[i][0], c_zx[i], [&](int z) { return zx_test(i, z, p.x()); });
+				c_xy[i] += n_xy[i][0];
+				c_zx[i] += n_zx[i][1];
+			}
+			//the column misses the triangle in xy or in zx
+			if (yLo >= yHi || zxLo >= zxHi)
+				continue;
+
+			// rows whose plane z-range misses [zxLo, zxHi), most of them when the triangle is clipped to a tile
+			// (z_range is monotone in y as well)
+			clip_span(yLo, yHi, -nProj.y()*nzInv, (dTriMax - nProj.x()*p.x())*nzInv - zxLo, [&](int y) {
+				z_range(Eigen::Vector3i(p.x(), y, 0), zMin, zMax);
+				return zMax > zxLo;
+			});
+			clip_span(yLo, yHi, nProj.y()*nzInv, zxHi - (dTriMin - nProj.x()*p.x())*nzInv, [&](int y) {
+				z_range(Eigen::Vector3i(p.x(), y, 0), zMin, zMax);
+				return zMin < zxHi;
+			});
+
+			for (int i = 0; i < 3; i++)
+				c_yz[i] = d_yz[i] + n_yz[i][0]*yLo;
+			for (p.y() = yLo; p.y() < yHi; p.y()++) {
+				z_range(p, zMin, zMax);
+				zMin = std::max(zxLo, zMin);
+				zMax = std::min(zxHi, zMax);
+				// thin surfaces give runs of one or two cells, those are tested directly
+				bool short_run = zMax - zMin <= MIN_CLIP_SPAN;
+				for (int i = 0; i < 3; i++) {
+					if (!short_run)
+						clip_span(zMin, zMax, n_yz[i][1], c_yz[i], [&](int z) { return yz_test(i, p.y(), z); });
+					c_yz[i] += n_yz[i][0];
+				}
+
+				size_t index = p.x()*step[0] + p.y()*step[1] + zMin*step[2];
+				for (p.z() = zMin; p.z() < zMax; p.z()++, index += step[2])
+					if (!short_run || (yz_test(0, p.y(), p.z()) && yz_test(1, p.y(), p.z()) && yz_test(2, p.y(), p.z())))
+						image[index] = 1;
+			}
+		}
+	}
+
+
+	// Integer-snapped mode. Vertices are snapped to a fixed-point lattice of 1/2^SUBVOXEL_BITS voxel
+	// and all edge functions are evaluated exactly in 64-bit integers, so every backend implementing
+	// it (this one and VoxelizationGS.glsl with EXACT) produces bit-identical grids. With 8 sub-voxel
+	// bits the largest intermediate (the plane offset, ~2^57) stays within int64 up to dim 1024.
+	const int SUBVOXEL_BITS = 8;
+	const int EXACT_MAX_DIM = 1024;
+
+	typedef Eigen::Matrix<int64_t, 3, 1> Vector3l;
+
+	// snaps the unit cube vertices to the fixed-point voxel lattice (host side, so all backends share the rounding)
+	inline void quantize_positions(const Eigen::Matrix<float, -1, -1> &V, const int voxelResolution[3], Eigen::Matrix<int32_t, 3, -1> &Q) {
+		Q.resize(3, V.cols());
+		for (int i = 0; i < V.cols(); i++)
+			for (int k = 0; k < 3; k++)
+				Q(k, i) = (int32_t)std::llround((double)V(k, i)*voxelResolution[k]*(1 << SUBVOXEL_BITS));
+	}
+
+	// floor(num/den) for den > 0, exact is set when den divides num (only non-negative divisions, like the shader)
+	inline int64_t floor_div(int64_t num, int64_t den, bool &exact) {
+		if (num >= 0) {
+			int64_t q = num/den;
+			exact = q*den == num;
+			return q;
+		}
+		int64_t q = (-num)/den;
+		exact = q*den == -num;
+		return exact ? -q : -q - 1;
+	}
+
+	inline int64_t ceil_div(int64_t num, int64_t den, bool &exact) {
+		return -floor_div(-num, den, exact);
+	}
+
+	inline int64_t max0(int64_t a) {
+		return a > 0 ? a : 0;
+	}
+
+	inline int64_t min0(int64_t a) {
+		return a < 0 ? a : 0;
+	}
+
+	// voxel z-range [zMin, zMax) of the plane slab num/den, a boundary hit exactly takes the voxels
+	// on both sides (the floor/ceil trick of the float path)
+	inline void plane_z_range(int64_t numMin, int64_t numMax, int64_t den, int &zMin, int &zMax) {
+		bool exact;
+		zMin = (int)floor_div(numMin, den, exact);
+		zMin -= exact;
+		zMax = (int)ceil_div(numMax, den, exact);
+		zMax += exact;
+	}
+
+	// clip_span for an exact edge test c + n*t*s >= 0, the crossing is found by division alone
+	inline void clip_span_exact(int &lo, int &hi, int64_t n, int64_t c, int64_t s) {
+		bool exact;
+		if (lo >= hi)
+			return;
+		if (n > 0)
+			lo = (int)std::min(std::max((int64_t)lo, ceil_div(-c, n*s, exact)), (int64_t)hi);
+		else if (n < 0)
+			hi = (int)std::max(std::min((int64_t)hi, floor_div(c, -n*s, exact) + 1), (int64_t)lo);
+		else if (c < 0)
+			hi = lo;
+	}
+
+
+	// voxel bounding box [lo, hi) of a fixed-point triangle, before clamping to the grid
+	inline void triangle_bounds_exact(const Vector3l &v0, const Vector3l &v1, const Vector3l &v2, Eigen::Vector3i &lo, Eigen::Vector3i &hi) {
+		const int64_t s = 1 << SUBVOXEL_BITS;
+		bool exact;
+		for (int i = 0; i < 3; i++) {
+			lo[i] = (int)floor_div(std::min(std::min(v0[i], v1[i]), v2[i]), s, exact);
+			hi[i] = (int)ceil_div(std::max(std::max(v0[i], v1[i]), v2[i]), s, exact);
+		}
+	}
+
+	// same algorithm as voxelize_triangle on fixed-point vertices (see quantize_positions). Degenerate
+	// triangles (zero normal) are skipped, the float path has no defined result for them either.
+	inline void voxelize_triangle_exact(Vector3l v0, Vector3l v1, Vector3l v2, const int voxelResolution[3],
+			Thickness thickness, uint8_t *image, const Eigen::Vector3i &clipMin, const Eigen::Vector3i &clipMax) {
+		const int64_t s = 1 << SUBVOXEL_BITS;
+		const int64_t h = s/2;
+
+		Eigen::Vector3i lo, hi;
+		triangle_bounds_exact(v0, v1, v2, lo, hi);
+		lo = lo.cwiseMax(clipMin).cwiseMin(clipMax);
+		hi = hi.cwiseMax(clipMin).cwiseMin(clipMax);
+		if (cell_already_set(lo, hi, voxelResolution, image))
+			return;
+
+		Vector3l n = (v1 - v0).cross(v2 - v1);
+		if (n.isZero())
+			return;
+		Vector3l absN = n.cwiseAbs();
+		int axis = 2;
+		auto yzx = [](const Vector3l &v) { return Vector3l(v.y(), v.z(), v.x()); };
+		auto zxy = [](const Vector3l &v) { return Vector3l(v.z(), v.x(), v.y()); };
+		if (absN.x() >= absN.y() && absN.x() >= absN.z()) {
+			v0 = yzx(v0); v1 = yzx(v1); v2 = yzx(v2); n = yzx(n);
+			axis = 0;
+		} else if (absN.y() >= absN.x() && absN.y() >= absN.z()) {
+			v0 = zxy(v0); v1 = zxy(v1); v2 = zxy(v2); n = zxy(n);
+			axis = 1;
+		}
+
+		const Eigen::Vector3i minVoxIndex = swizzle(lo, axis), maxVoxIndex = swizzle(hi, axis);
+
+		const Vector3l e[3] = {v1 - v0, v2 - v1, v0 - v2};
+		const Vector3l *v[3] = {&v0, &v1, &v2};
+
+		//INward Facing edge normals and offsets, scaled by s^2
+		int64_t n_xy[3][2], n_yz[3][2], n_zx[3][2];
+		int64_t d_xy[3], d_yz[3], d_zx[3];
+		for (int i = 0; i < 3; i++) {
+			const Vector3l &ei = e[i];
+			n_xy[i][0] = n.z() >= 0 ? -ei.y() : ei.y();  n_xy[i][1] = n.z() >= 0 ? ei.x() : -ei.x();
+			n_yz[i][0] = n.x() >= 0 ? -ei.z() : ei.z();  n_yz[i][1] = n.x() >= 0 ? ei.y() : -ei.y();
+			n_zx[i][0] = n.y() >= 0 ? -ei.x() : ei.x();  n_zx[i][1] = n.y() >= 0 ? ei.z() : -ei.z();
+
+			const Vector3l &vi = *v[i];
+			if (thickness == THIN) {
+				d_xy[i] = n_xy[i][0]*(h - vi.x()) + n_xy[i][1]*(h - vi.y()) + h*std::max(std::abs(n_xy[i][0]), std::abs(n_xy[i][1]));
+				d_yz[i] = n_yz[i][0]*(h - vi.y()) + n_yz[i][1]*(h - vi.z()) + h*std::max(std::abs(n_yz[i][0]), std::abs(n_yz[i][1]));
+				d_zx[i] = n_zx[i][0]*(h - vi.z()) + n_zx[i][1]*(h - vi.x()) + h*std::max(std::abs(n_zx[i][0]), std::abs(n_zx[i][1]));
+			} else {
+				d_xy[i] = -(n_xy[i][0]*vi.x() + n_xy[i][1]*vi.y()) + s*(max0(n_xy[i][0]) + max0(n_xy[i][1]));
+				d_yz[i] = -(n_yz[i][0]*vi.y() + n_yz[i][1]*vi.z()) + s*(max0(n_yz[i][0]) + max0(n_yz[i][1]));
+				d_zx[i] = -(n_zx[i][0]*vi.z() + n_zx[i][1]*vi.x()) + s*(max0(n_zx[i][0]) + max0(n_zx[i][1]));
+			}
+		}
+
+		//plane offsets, scaled by s^3
+		Vector3l nProj = n.z() < 0 ? Vector3l(-n) : n;
+		const int64_t dTri = nProj.dot(v0);
+		const int64_t dTriMin = thickness == THIN ? dTri - h*(nProj.x() + nProj.y()) : dTri - s*(max0(nProj.x()) + max0(nProj.y()));
+		const int64_t dTriMax = thickness == THIN ? dTriMin : dTri - s*(min0(nProj.x()) + min0(nProj.y()));
+		const int64_t den = nProj.z()*s;
+
+		size_t step[3];
+		swizzled_steps(axis, voxelResolution, step);
+
+		Eigen::Vector3i p;
+		if ((maxVoxIndex - minVoxIndex).maxCoeff() <= MIN_CLIP_SPAN) {
+			for (p.x() = minVoxIndex.x(); p.x() < maxVoxIndex.x(); p.x()++) {
+				for (p.y() = minVoxIndex.y(); p.y() < maxVoxIndex.y(); p.y()++) {
+					const int64_t px = p.x()*s, py = p.y()*s;
+					bool xy_overlap = true;
+					for (int i = 0; i < 3; i++)
+						xy_overlap = xy_overlap && (d_xy[i] + n_xy[i][0]*px + n_xy[i][1]*py >= 0);
+
+					if (!xy_overlap)
+						continue;
+
+					const int64_t dot_n_p = nProj.x()*px + nProj.y()*py;
+					int zMin, zMax;
+					plane_z_range(dTriMin - dot_n_p, dTriMax - dot_n_p, den, zMin, zMax);
+					zMin = std::max(minVoxIndex.z(), zMin);
+					zMax = std::min(maxVoxIndex.z(), zMax);
+
+					for (p.z() = zMin; p.z() < zMax; p.z()++) {
+						const int64_t pz = p.z()*s;
+						bool yz_overlap = true, zx_overlap = true;
+						for (int i = 0; i < 3; i++) {
+							yz_overlap = yz_overlap && (d_yz[i] + n_yz[i][0]*py + n_yz[i][1]*pz >= 0);
+							zx_overlap = zx_overlap && (d_zx[i] + n_zx[i][0]*pz + n_zx[i][1]*px >= 0);
+						}
+						if (yz_overlap && zx_overlap)
+							image[p.x()*step[0] + p.y()*step[1] + p.z()*step[2]] = 1;
+					}
+				}
+			}
+			return;
+		}
+
+		// Same span clipping as voxelize_triangle, here the crossings are exact divisions and the
+		// edge and plane values are stepped incrementally without error, so no cell is tested.
+		for (p.x() = minVoxIndex.x(); p.x() < maxVoxIndex.x(); p.x()++) {
+			const int64_t px = p.x()*s;
+			int yLo = minVoxIndex.y(), yHi = maxVoxIndex.y();
+			int zxLo = minVoxIndex.z(), zxHi = maxVoxIndex.z();
+			for (int i = 0; i < 3; i++) {
+				clip_span_exact(yLo, yHi, n_xy[i][1], d_xy[i] + n_xy[i][0]*px, s);
+				clip_span_exact(zxLo, zxHi, n_zx[i][0], d_zx[i] + n_zx[i][1]*px, s);
+			}
+			//the column misses the triangle in xy or in zx
+			if (yLo >= yHi || zxLo >= zxHi)
+				continue;
+
+			int64_t c_yz[3];
+			for (int i = 0; i < 3; i++)
+				c_yz[i] = d_yz[i] + n_yz[i][0]*yLo*s;
+			int64_t dot_n_p = nProj.x()*px + nProj.y()*yLo*s;
+			for (p.y() = yLo; p.y() < yHi; p.y()++, dot_n_p += nProj.y()*s) {
+				int zMin, zMax;
+				plane_z_range(dTriMin - dot_n_p, dTriMax - dot_n_p, den, zMin, zMax);
+
+				zMin = std::max(zxLo, zMin);
+				zMax = std::min(zxHi, zMax);
+				for (int i = 0; i < 3; i++) {
+					clip_span_exact(zMin, zMax, n_yz[i][1], c_yz[i], s);
+					c_yz[i] += n_yz[i][0]*s;
+				}
+
+				size_t index = p.x()*step[0] + p.y()*step[1] + zMin*step[2];
+				for (p.z() = zMin; p.z() < zMax; p.z()++, index += step[2])
+					image[index] = 1;
+			}
+		}
+	}
+
+	// Parallel scheduler. Triangles are binned into 32^3 voxel tiles (every tile their bounding box
+	// touches) and each tile is voxelized by a single thread with the triangles clipped to it, so every
+	// grid byte has one writer and no atomics or locks are needed. Tiles are handed out dynamically,
+	// fullest first, since scanned meshes pack most of their triangles into few tiles. Small grids
+	// use tiles down to 8^3 so that there are enough of them for all threads.
+	const int MAX_TILE_BITS = 5;
+	const int MIN_TILE_BITS = 3;
+	const int TILES_PER_THREAD = 8;
+
+	// bounds(i, lo, hi) gives a voxel box [lo, hi) containing triangle i (a loose one only costs empty
+	// clipped calls), voxelize(i, clipMin, clipMax) voxelizes it restricted to a box of the grid
+	template <typename Bounds, typename Voxelize>
+	inline void voxelize_tiled(int nTriangles, const int voxelResolution[3], Bounds bounds, Voxelize voxelize) {
+		const Eigen::Vector3i res(voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+		const int nThreads = omp_get_max_threads();
+		if (nThreads == 1) {
+			for (int i = 0; i < nTriangles; i++)
+				voxelize(i, Eigen::Vector3i::Zero(), res);
+			return;
+		}
+
+		int bits = MAX_TILE_BITS;
+		auto tile_count = [&](int b) { return Eigen::Vector3i(((res.x() - 1) >> b) + 1, ((res.y() - 1) >> b) + 1, ((res.z() - 1) >> b) + 1); };
+		while (bits > MIN_TILE_BITS && tile_count(bits).prod() < TILES_PER_THREAD*nThreads)
+			bits--;
+		const Eigen::Vector3i tiles = tile_count(bits);
+		const int nTiles = tiles.prod();
+
+		// calls f(tile) for every tile overlapped by the bounding box of triangle i
+		auto for_each_tile = [&](int i, auto f) {
+			Eigen::Vector3i lo, hi;
+			bounds(i, lo, hi);
+			lo = lo.cwiseMax(Eigen::Vector3i::Zero());
+			hi = hi.cwiseMin(res);
+			if ((lo.array() >= hi.array()).any())
+				return;
+			for (int tz = lo.z() >> bits; tz <= (hi.z() - 1) >> bits; tz++)
+				for (int ty = lo.y() >> bits; ty <= (hi.y() - 1) >> bits; ty++)
+					for (int tx = lo.x() >> bits; tx <= (hi.x() - 1) >> bits; tx++)
+						f((tz*tiles.y() + ty)*tiles.x() + tx);
+		};
+
+		// counting sort of the (tile, triangle) pairs. count[thread][tile] turns into the write offset of
+		// the thread in the list of the tile; each thread bins a contiguous range of triangles, so every
+		// list stays in triangle order whatever the thread count.
+		std::vector<size_t> count((size_t)nThreads*nTiles, 0), tileBegin(nTiles + 1);
+		std::vector<int> binned, order;
+		#pragma omp parallel num_threads(nThreads)
+		{
+			const int t = omp_get_thread_num();
+			const int begin = (int)((int64_t)nTriangles*t/nThreads);
+			const int end = (int)((int64_t)nTriangles*(t + 1)/nThreads);
+			size_t *own = &count[(size_t)t*nTiles];
+			for (int i = begin; i < end; i++)
+				for_each_tile(i, [&](int tile) { own[tile]++; });
+			#pragma omp barrier
+
+			#pragma omp single
+			{
+				size_t sum = 0;
+				for (int tile = 0; tile < nTiles; tile++) {
+					tileBegin[tile] = sum;
+					for (int k = 0; k < nThreads; k++) {
+						size_t c = count[(size_t)k*nTiles + tile];
+						count[(size_t)k*nTiles + tile] = sum;
+						sum += c;
+					}
+				}
+				tileBegin[nTiles] = sum;
+				binned.resize(sum);
+			}
+
+			for (int i = begin; i < end; i++)
+				for_each_tile(i, [&](int tile) { binned[own[tile]++] = i; });
+
+			#pragma omp single
+			{
+				for (int tile = 0; tile < nTiles; tile++)
+					if (tileBegin[tile + 1] > tileBegin[tile])
+						order.push_back(tile);
+				std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+					return tileBegin[a + 1] - tileBegin[a] > tileBegin[b + 1] - tileBegin[b];
+				});
+			}
+
+			#pragma omp for schedule(dynamic, 1)
+			for (int k = 0; k < (int)order.size(); k++) {
+				const int tile = order[k];
+				const Eigen::Vector3i clipMin = Eigen::Vector3i(tile % tiles.x(), tile/tiles.x() % tiles.y(), tile/(tiles.x()*tiles.y()))*(1 << bits);
+				const Eigen::Vector3i clipMax = (clipMin + Eigen::Vector3i::Constant(1 << bits)).cwiseMin(res);
+				for (size_t j = tileBegin[tile]; j < tileBegin[tile + 1]; j++)
+					voxelize(binned[j], clipMin, clipMax);
+			}
+		}
+	}
+
+	// voxelizes the triangles faces[3*i], faces[3*i + 1], faces[3*i + 2] (i < nFaces) with fixed-point
+	// vertices Q (see quantize_positions) into a zeroed dense occupancy grid, on all OpenMP threads
+	inline void voxelize_faces_exact(const Eigen::Matrix<int32_t, 3, -1> &Q, const uint32_t *faces, int nFaces,
+			const int voxelResolution[3], Thickness thickness, uint8_t *image) {
+		auto vertex = [&](int i, int k) { return Vector3l(Q.col(faces[3*i + k]).cast<int64_t>()); };
+		voxelize_tiled(nFaces, voxelResolution,
+			[&](int i, Eigen::Vector3i &lo, Eigen::Vector3i &hi) {
+				triangle_bounds_exact(vertex(i, 0), vertex(i, 1), vertex(i, 2), lo, hi);
+			},
+			[&](int i, const Eigen::Vector3i &clipMin, const Eigen::Vector3i &clipMax) {
+				voxelize_triangle_exact(vertex(i, 0), vertex(i, 1), vertex(i, 2), voxelResolution, thickness, image, clipMin, clipMax);
+			});
+	}
+
+	// same for the triangles of a mesh normalized to the unit cube
+	inline void voxelize_faces(const meshh::Mesh &mesh, const uint32_t *faces, int nFaces, const int voxelResolution[3],
+			Thickness thickness, uint8_t *image, bool exact = false) {
+		if (exact) {
+			assert(voxelResolution[0] <= EXACT_MAX_DIM && voxelResolution[1] <= EXACT_MAX_DIM && voxelResolution[2] <= EXACT_MAX_DIM);
+			Eigen::Matrix<int32_t, 3, -1> Q;
+			quantize_positions(mesh.V, voxelResolution, Q);
+			voxelize_faces_exact(Q, faces, nFaces, voxelResolution, thickness, image);
+			return;
+		}
+		Eigen::Vector3f scale(voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+		auto vertex = [&](int i, int k) { return Eigen::Vector3f(mesh.V.col(faces[3*i + k]).cwiseProduct(scale)); };
+		voxelize_tiled(nFaces, voxelResolution,
+			[&](int i, Eigen::Vector3i &lo, Eigen::Vector3i &hi) {
+				// truncation instead of floor/ceil, the same after clamping to the grid except for a
+				// spurious extra tile when a triangle ends exactly on a tile boundary
+				Eigen::Vector3f v0 = vertex(i, 0), v1 = vertex(i, 1), v2 = vertex(i, 2);
+				lo = v0.cwiseMin(v1).cwiseMin(v2).cast<int>();
+				hi = v0.cwiseMax(v1).cwiseMax(v2).cast<int>() + Eigen::Vector3i::Ones();
+			},
+			[&](int i, const Eigen::Vector3i &clipMin, const Eigen::Vector3i &clipMax) {
+				voxelize_triangle(vertex(i, 0), vertex(i, 1), vertex(i, 2), voxelResolution, thickness, image, clipMin, clipMax);
+			});
+	}
+
+	// voxelizes a mesh normalized to the unit cube into a dense occupancy grid, on all OpenMP threads
+	inline void voxelize(const meshh::Mesh &mesh, const int voxelResolution[3], Thickness thickness, std::vector<uint8_t> &image,
+			bool exact = false) {
+		image.assign((size_t)voxelResolution[0]*voxelResolution[1]*voxelResolution[2], 0);
+		voxelize_faces(mesh, mesh.F.data(), mesh.F.cols(), voxelResolution, thickness, image.data(), exact);
+	}
+
+	// Sub-voxel triangle merging. At low dim most triangles of a dense scan have all three vertices in
+	// one voxel, so they can set at most that cell. split_subvoxel keeps only the triangles spanning
+	// voxels for the full overlap test of another backend and voxelizes the others here (nearly all of
+	// them stop at cell_already_set), returning the cells they set as linear grid indices (x fastest)
+	// to be written as points. The cells are still tested because a THIN triangle may miss its own one.
+	// Triangles with an empty voxel box set nothing in either backend and are dropped.
+	inline void split_subvoxel(const meshh::Mesh &mesh, const int voxelResolution[3], Thickness thickness, bool exact,
+			Eigen::Matrix<uint32_t, -1, -1> &spanning, std::vector<uint32_t> &cells) {
+		const Eigen::Vector3i res(voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+		const int nFaces = mesh.F.cols();
+		Eigen::Matrix<int32_t, 3, -1> Q;
+		if (exact)
+			quantize_positions(mesh.V, voxelResolution, Q);
+		const Eigen::Vector3f scale = res.cast<float>();
+
+		// cell of every sub-voxel triangle, EMPTY or SPANNING for the others
+		const uint32_t EMPTY = ~0u, SPANNING = ~0u - 1;
+		std::vector<uint32_t> cell(nFaces);
+		#pragma omp parallel for
+		for (int i = 0; i < nFaces; i++) {
+			Eigen::Vector3i lo, hi;
+			if (exact)
+				triangle_bounds_exact(Vector3l(Q.col(mesh.F(0, i)).cast<int64_t>()), Vector3l(Q.col(mesh.F(1, i)).cast<int64_t>()),
+					Vector3l(Q.col(mesh.F(2, i)).cast<int64_t>()), lo, hi);
+			else
+				triangle_bounds(mesh.V.col(mesh.F(0, i)).cwiseProduct(scale), mesh.V.col(mesh.F(1, i)).cwiseProduct(scale),
+					mesh.V.col(mesh.F(2, i)).cwiseProduct(scale), lo, hi);
+			lo = lo.cwiseMax(Eigen::Vector3i::Zero());
+			hi = hi.cwiseMin(res);
+			if ((hi - lo).minCoeff() <= 0)
+				cell[i] = EMPTY;
+			else if (hi - lo != Eigen::Vector3i::Ones())
+				cell[i] = SPANNING;
+			else
+				cell[i] = (lo.z()*res.y() + lo.y())*res.x() + lo.x();
+		}
+
+		std::vector<uint32_t> subvoxel;
+		spanning.resize(3, std::count(cell.begin(), cell.end(), SPANNING));
+		for (int i = 0, j = 0; i < nFaces; i++) {
+			if (cell[i] == SPANNING)
+				spanning.col(j++) = mesh.F.col(i);
+			else if (cell[i] != EMPTY)
+				subvoxel.insert(subvoxel.end(), mesh.F.col(i).data(), mesh.F.col(i).data() + 3);
+		}
+
+		std::vector<uint8_t> image((size_t)res.prod(), 0);
+		if (exact)
+			voxelize_faces_exact(Q, subvoxel.data(), subvoxel.size()/3, voxelResolution, thickness, image.data());
+		else
+			voxelize_faces(mesh, subvoxel.data(), subvoxel.size()/3, voxelResolution, thickness, image.data());
+
+		// set cells are listed once, then marked with 2
+		cells.clear();
+		for (int i = 0; i < nFaces; i++) {
+			if (cell[i] >= SPANNING || image[cell[i]] != 1)
+				continue;
+			cells.push_back(cell[i]);
+			image[cell[i]] = 2;
+		}
+	}
+
+	// Label grid of a scene (see meshh::Scene): every voxel holds the label of the last object setting
+	// it, i.e. the largest one like the atomic max of VoxelizationGS.glsl, 0 if none. The objects are
+	// voxelized one after the other into a scratch occupancy grid, which is scanned and cleared again
+	// only within the voxel box of the object, so a scene costs one pass over its objects' boxes.
+	inline void voxelize_labels(const meshh::Scene &scene, const int voxelResolution[3], Thickness thickness,
+			std::vector<uint16_t> &labels, bool exact = false) {
+		const Eigen::Vector3i res(voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+		const meshh::Mesh &mesh = scene.mesh;
+		labels.assign((size_t)res.prod(), 0);
+		std::vector<uint8_t> image(labels.size(), 0);
+		Eigen::Matrix<int32_t, 3, -1> Q;
+		if (exact) {
+			assert(res.maxCoeff() <= EXACT_MAX_DIM);
+			quantize_positions(mesh.V, voxelResolution, Q);
+		}
+
+		for (int i = 0; i < scene.n_objects(); i++) {
+			const uint32_t *faces = mesh.F.data() + 3*(size_t)scene.object_faces[i];
+			const int nFaces = scene.object_faces[i + 1] - scene.object_faces[i];
+			if (nFaces == 0)
+				continue;
+			if (exact)
+				voxelize_faces_exact(Q, faces, nFaces, voxelResolution, thickness, image.data());
+			else
+				voxelize_faces(mesh, faces, nFaces, voxelResolution, thickness, image.data());
+
+			// voxel box of the object, one voxel of slack for rounding
+			Eigen::Vector3f vmin = mesh.V.col(faces[0]), vmax = vmin;
+			for (int j = 1; j < 3*nFaces; j++) {
+				vmin = vmin.cwiseMin(mesh.V.col(faces[j]));
+				vmax = vmax.cwiseMax(mesh.V.col(faces[j]));
+			}
+			Eigen::Vector3i lo, hi;
+			for (int k = 0; k < 3; k++) {
+				lo[k] = std::max((int)std::floor(vmin[k]*res[k]) - 1, 0);
+				hi[k] = std::min((int)std::ceil(vmax[k]*res[k]) + 1, res[k]);
+			}
+
+			const uint16_t label = i + 1;
+			#pragma omp parallel for
+			for (int z = lo.z(); z < hi.z(); z++) {
+				for (int y = lo.y(); y < hi.y(); y++) {
+					size_t index = ((size_t)z*res.y() + y)*res.x() + lo.x();
+					for (int x = lo.x(); x < hi.x(); x++, index++) {
+						if (image[index]) {
+							labels[index] = label;
+							image[index] = 0;
+						}
+					}
+				}
+			}
+		}
+	}
+}
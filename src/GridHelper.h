@@ -0,0 +1,560 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <charconv>
+#include <iterator>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GRIDH_X86 1
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Bit-packed occupancy grids and their binary file format (.voxb). Bit i of the grid is voxel
+// x + y*dimx + z*dimx*dimy (same order as the dense grid read back from the GPU), stored as bit
+// i % 64 of word i / 64. Label grids of scenes (.voxl) hold one uint16 per voxel in the same order.
+namespace gridh {
+	struct BitGrid {
+		int dim[3] = {0, 0, 0};
+		std::vector<uint64_t> words;
+
+		size_t size() const {
+			return (size_t)dim[0]*dim[1]*dim[2];
+		}
+
+		void resize(const int d[3]) {
+			for (int i = 0; i < 3; i++)
+				dim[i] = d[i];
+			words.assign((size() + 63)/64, 0);
+		}
+
+		bool get(size_t i) const {
+			return (words[i >> 6] >> (i & 63)) & 1;
+		}
+
+		void set(size_t i) {
+			words[i >> 6] |= uint64_t(1) << (i & 63);
+		}
+	};
+
+	// on-disk header, followed by n_words little-endian uint64 words
+	struct FileHeader {
+		char magic[4];
+		uint32_t version;
+		int32_t dim[3];
+		uint32_t reserved;
+		uint64_t n_words;
+	};
+
+	// The word functions work on grids in caller memory (see voxelizer.h): n voxels in (n + 63)/64
+	// words. They run on all OpenMP threads, one word per iteration.
+	inline void pack_words(const uint8_t *image, size_t n, uint64_t *words) {
+		const int64_t n_words = (n + 63)/64;
+		#pragma omp parallel for schedule(static)
+		for (int64_t w = 0; w < n_words; w++) {
+			const size_t first = 64*w, last = std::min(n, first + 64);
+			uint64_t word = 0;
+			for (size_t i = first; i < last; i++)
+				word |= uint64_t(image[i] != 0) << (i - first);
+			words[w] = word;
+		}
+	}
+
+	inline void unpack_words(const uint64_t *words, size_t n, uint8_t *image) {
+		const int64_t n_words = (n + 63)/64;
+		#pragma omp parallel for schedule(static)
+		for (int64_t w = 0; w < n_words; w++) {
+			const size_t first = 64*w, last = std::min(n, first + 64);
+			for (size_t i = first; i < last; i++)
+				image[i] = (words[w] >> (i - first)) & 1;
+		}
+	}
+
+	inline size_t count_words(const uint64_t *words, size_t n_words) {
+		size_t n = 0;
+		#pragma omp parallel for schedule(static) reduction(+: n)
+		for (int64_t w = 0; w < (int64_t)n_words; w++)
+			n += __builtin_popcountll(words[w]);
+		return n;
+	}
+
+	// Writes x, y, z (uint16) of every set voxel in grid order and returns their number. Blocks of
+	// words are counted first, so that every thread knows where its coordinates start.
+	inline size_t to_coords(const uint64_t *words, const int dim[3], uint16_t *coords) {
+		const size_t n_words = ((size_t)dim[0]*dim[1]*dim[2] + 63)/64;
+		const size_t block = 4096, n_blocks = (n_words + block - 1)/block;
+		std::vector<size_t> start(n_blocks + 1, 0);
+		#pragma omp parallel for schedule(static)
+		for (int64_t k = 0; k < (int64_t)n_blocks; k++)
+			start[k + 1] = count_words(words + k*block, std::min(block, n_words - k*block));
+		for (size_t k = 0; k < n_blocks; k++)
+			start[k + 1] += start[k];
+
+		const size_t dxy = (size_t)dim[0]*dim[1];
+		#pragma omp parallel for schedule(static)
+		for (int64_t k = 0; k < (int64_t)n_blocks; k++) {
+			uint16_t *out = coords + 3*start[k];
+			for (size_t w = k*block; w < std::min(n_words, (k + 1)*block); w++) {
+				for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+					size_t i = 64*w + __builtin_ctzll(bits);
+					*out++ = i % dim[0];
+					*out++ = (i / dim[0]) % dim[1];
+					*out++ = i / dxy;
+				}
+			}
+		}
+		return start[n_blocks];
+	}
+
+	inline void pack(const uint8_t *image, const int dim[3], BitGrid &grid) {
+		grid.resize(dim);
+		pack_words(image, grid.size(), grid.words.data());
+	}
+
+	inline void pack(const std::vector<uint8_t> &image, const int dim[3], BitGrid &grid) {
+		pack(image.data(), dim, grid);
+	}
+
+	inline void unpack(const BitGrid &grid, std::vector<uint8_t> &image) {
+		image.resize(grid.size());
+		unpack_words(grid.words.data(), grid.size(), image.data());
+	}
+
+	inline size_t count(const BitGrid &grid) {
+		return count_words(grid.words.data(), grid.words.size());
+	}
+
+	// number of voxels set in exactly one of the two grids, or -1 if the dimensions differ
+	inline int64_t count_mismatches(const BitGrid &a, const BitGrid &b) {
+		if (a.dim[0] != b.dim[0] || a.dim[1] != b.dim[1] || a.dim[2] != b.dim[2])
+			return -1;
+		int64_t n = 0;
+		for (size_t i = 0; i < a.words.size(); i++)
+			n += __builtin_popcountll(a.words[i] ^ b.words[i]);
+		return n;
+	}
+
+	inline bool save_binary(const std::string &filename, const BitGrid &grid) {
+		std::ofstream out(filename, std::ios::out | std::ios::binary);
+		if (!out.is_open()) {
+			fprintf(stderr, "Error: Could not write %s.\n", filename.c_str());
+			return false;
+		}
+		FileHeader header;
+		std::memcpy(header.magic, "VOXB", 4);
+		header.version = 1;
+		for (int i = 0; i < 3; i++)
+			header.dim[i] = grid.dim[i];
+		header.reserved = 0;
+		header.n_words = grid.words.size();
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)grid.words.data(), grid.words.size()*sizeof(uint64_t));
+		return out.good();
+	}
+
+	inline bool load_binary(const std::string &filename, BitGrid &grid) {
+		std::ifstream in(filename, std::ios::in | std::ios::binary);
+		if (!in.is_open()) {
+			fprintf(stderr, "Error: Could not read %s.\n", filename.c_str());
+			return false;
+		}
+		FileHeader header;
+		in.read((char*)&header, sizeof(header));
+		if (!in.good() || std::memcmp(header.magic, "VOXB", 4) != 0 || header.version != 1) {
+			fprintf(stderr, "Error: %s is not a binary voxel grid.\n", filename.c_str());
+			return false;
+		}
+		int dim[3] = {header.dim[0], header.dim[1], header.dim[2]};
+		grid.resize(dim);
+		if (header.n_words != grid.words.size()) {
+			fprintf(stderr, "Error: %s is truncated.\n", filename.c_str());
+			return false;
+		}
+		in.read((char*)grid.words.data(), grid.words.size()*sizeof(uint64_t));
+		return in.good();
+	}
+
+	// label grids use the same header with magic "VOXL", n_words then counts uint16 labels
+	inline bool save_labels(const std::string &filename, const int dim[3], const std::vector<uint16_t> &labels) {
+		std::ofstream out(filename, std::ios::out | std::ios::binary);
+		if (!out.is_open()) {
+			fprintf(stderr, "Error: Could not write %s.\n", filename.c_str());
+			return false;
+		}
+		FileHeader header;
+		std::memcpy(header.magic, "VOXL", 4);
+		header.version = 1;
+		for (int i = 0; i < 3; i++)
+			header.dim[i] = dim[i];
+		header.reserved = 0;
+		header.n_words = labels.size();
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)labels.data(), labels.size()*sizeof(uint16_t));
+		return out.good();
+	}
+
+	inline bool load_labels(const std::string &filename, int dim[3], std::vector<uint16_t> &labels) {
+		std::ifstream in(filename, std::ios::in | std::ios::binary);
+		if (!in.is_open()) {
+			fprintf(stderr, "Error: Could not read %s.\n", filename.c_str());
+			return false;
+		}
+		FileHeader header;
+		in.read((char*)&header, sizeof(header));
+		if (!in.good() || std::memcmp(header.magic, "VOXL", 4) != 0 || header.version != 1) {
+			fprintf(stderr, "Error: %s is not a label grid.\n", filename.c_str());
+			return false;
+		}
+		for (int i = 0; i < 3; i++)
+			dim[i] = header.dim[i];
+		labels.resize((size_t)dim[0]*dim[1]*dim[2]);
+		if (header.n_words != labels.size()) {
+			fprintf(stderr, "Error: %s is truncated.\n", filename.c_str());
+			return false;
+		}
+		in.read((char*)labels.data(), labels.size()*sizeof(uint16_t));
+		return in.good();
+	}
+
+	// Read-only view of a whole file: mapped on POSIX systems, read into memory on Windows.
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile &operator=(const MappedFile&) = delete;
+
+		~MappedFile() {
+			close();
+		}
+
+		bool open(const std::string &filename) {
+			close();
+#ifndef _WIN32
+			int fd = ::open(filename.c_str(), O_RDONLY);
+			struct stat st;
+			if (fd < 0 || fstat(fd, &st) != 0) {
+				fprintf(stderr, "Error: Could not read %s.\n", filename.c_str());
+				if (fd >= 0)
+					::close(fd);
+				return false;
+			}
+			size = st.st_size;
+			if (size) {
+				map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (map == MAP_FAILED) {
+					map = NULL;
+					size = 0;
+					::close(fd);
+					fprintf(stderr, "Error: Could not map %s.\n", filename.c_str());
+					return false;
+				}
+				madvise(map, size, MADV_SEQUENTIAL);
+			}
+			::close(fd);
+			data = (const char*)map;
+#else
+			std::ifstream in(filename, std::ios::in | std::ios::binary);
+			if (!in.is_open()) {
+				fprintf(stderr, "Error: Could not read %s.\n", filename.c_str());
+				return false;
+			}
+			buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			data = buffer.data();
+			size = buffer.size();
+#endif
+			return true;
+		}
+
+		void close() {
+#ifndef _WIN32
+			if (map)
+				munmap(map, size);
+#endif
+			map = NULL;
+			buffer.clear();
+			data = NULL;
+			size = 0;
+		}
+
+		const char *data = NULL;
+		size_t size = 0;
+
+	private:
+		void *map = NULL;
+		std::string buffer;
+	};
+
+	// Text grids (.vox, see voxh::save_file): the dim, the voxel count, then one "x y z" line per
+	// voxel with coordinates divided by dim. Only cubic grids have a text form. The coordinates are
+	// parsed with std::from_chars and rounded back to voxel indices, which is exact for the six
+	// significant digits save_file writes up to dims of about 10^5.
+	inline bool parse_text(const char *p, const char *end, BitGrid &grid, const std::string &filename) {
+		auto skip = [&]() {
+			while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+				p++;
+		};
+		auto read = [&](auto &value) {
+			skip();
+			std::from_chars_result r = std::from_chars(p, end, value);
+			p = r.ptr;
+			return r.ec == std::errc();
+		};
+		int dim = 0;
+		size_t n = 0;
+		if (!read(dim) || !read(n) || dim <= 0) {
+			fprintf(stderr, "Error: %s is not a voxel grid.\n", filename.c_str());
+			return false;
+		}
+		const int d[3] = {dim, dim, dim};
+		grid.resize(d);
+		for (size_t i = 0; i < n; i++) {
+			float v[3];
+			if (!read(v[0]) || !read(v[1]) || !read(v[2])) {
+				fprintf(stderr, "Error: %s is truncated.\n", filename.c_str());
+				return false;
+			}
+			long c[3];
+			for (int k = 0; k < 3; k++)
+				c[k] = std::lround(v[k]*dim);
+			if (std::min(c[0], std::min(c[1], c[2])) < 0 || std::max(c[0], std::max(c[1], c[2])) >= dim) {
+				fprintf(stderr, "Error: %s has a voxel outside the grid.\n", filename.c_str());
+				return false;
+			}
+			grid.set((size_t)(c[2]*dim + c[1])*dim + c[0]);
+		}
+		return true;
+	}
+
+	inline bool load_text(const std::string &filename, BitGrid &grid) {
+		MappedFile file;
+		return file.open(filename) && parse_text(file.data, file.data + file.size, grid, filename);
+	}
+
+	inline bool save_text(const std::string &filename, const BitGrid &grid) {
+		if (grid.dim[0] != grid.dim[1] || grid.dim[0] != grid.dim[2]) {
+			fprintf(stderr, "Error: %s: only cubic grids can be written as text.\n", filename.c_str());
+			return false;
+		}
+		std::ofstream out(filename);
+		if (!out.is_open()) {
+			fprintf(stderr, "Error: Could not write %s.\n", filename.c_str());
+			return false;
+		}
+		const int dim = grid.dim[0];
+		out << dim << std::endl;
+		out << count(grid) << std::endl;
+		for (size_t w = 0; w < grid.words.size(); w++) {
+			for (uint64_t bits = grid.words[w]; bits; bits &= bits - 1) {
+				size_t i = w*64 + __builtin_ctzll(bits);
+				out << (float)(i % dim)/dim << " " << (float)(i/dim % dim)/dim << " " << (float)(i/((size_t)dim*dim))/dim << "\n";
+			}
+		}
+		return out.good();
+	}
+
+	// Read-only grid: .voxb files are mapped and their words used in place, text grids (.vox) are
+	// parsed into memory.
+	class GridFile {
+	public:
+		bool open(const std::string &filename) {
+			file.close();
+			grid = BitGrid();
+			words = NULL;
+			n_words = 0;
+			bool binary = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".voxb") == 0;
+			if (!binary) {
+				if (!load_text(filename, grid))
+					return false;
+				for (int i = 0; i < 3; i++)
+					dim[i] = grid.dim[i];
+				words = grid.words.data();
+				n_words = grid.words.size();
+				return true;
+			}
+			if (!file.open(filename))
+				return false;
+			FileHeader header;
+			if (file.size < sizeof(header) || (std::memcpy(&header, file.data, sizeof(header)), std::memcmp(header.magic, "VOXB", 4) != 0) ||
+					header.version != 1) {
+				fprintf(stderr, "Error: %s is not a binary voxel grid.\n", filename.c_str());
+				return false;
+			}
+			for (int i = 0; i < 3; i++)
+				dim[i] = header.dim[i];
+			n_words = ((size_t)dim[0]*dim[1]*dim[2] + 63)/64;
+			if (header.n_words != n_words || file.size < sizeof(header) + n_words*sizeof(uint64_t)) {
+				fprintf(stderr, "Error: %s is truncated.\n", filename.c_str());
+				n_words = 0;
+				return false;
+			}
+			words = (const uint64_t*)(file.data + sizeof(header));
+			return true;
+		}
+
+		int dim[3] = {0, 0, 0};
+		const uint64_t *words = NULL;
+		size_t n_words = 0;
+
+	private:
+		MappedFile file;
+		BitGrid grid;
+	};
+
+	// Boolean operations between two grids of the same size. One pass over both reads every word pair
+	// once, counts |a|, |b| and |a & b| and optionally writes the result of op; the rest follows from
+	// these three counts.
+	enum SetOp { UNION, INTERSECTION, DIFFERENCE, XOR };
+
+	struct SetCounts {
+		uint64_t a = 0, b = 0, both = 0;
+
+		uint64_t count(SetOp op) const {
+			if (op == UNION)
+				return a + b - both;
+			if (op == INTERSECTION)
+				return both;
+			if (op == DIFFERENCE)
+				return a - both;
+			return a + b - 2*both;
+		}
+
+		// intersection over union, 1 for two empty grids
+		double iou() const {
+			uint64_t u = count(UNION);
+			return u ? (double)both/u : 1.0;
+		}
+	};
+
+	template <SetOp OP>
+	inline uint64_t apply(uint64_t a, uint64_t b) {
+		return OP == UNION ? a | b : OP == INTERSECTION ? a & b : OP == DIFFERENCE ? a & ~b : a ^ b;
+	}
+
+	template <SetOp OP>
+	inline void compare_words(const uint64_t *a, const uint64_t *b, size_t n, uint64_t *out, SetCounts &c) {
+		for (size_t i = 0; i < n; i++) {
+			c.a += __builtin_popcountll(a[i]);
+			c.b += __builtin_popcountll(b[i]);
+			c.both += __builtin_popcountll(a[i] & b[i]);
+			if (out)
+				out[i] = apply<OP>(a[i], b[i]);
+		}
+	}
+
+#ifdef GRIDH_X86
+#pragma GCC push_options
+#pragma GCC target("popcnt")
+	// same loop with the popcnt instruction instead of the generic bit-twiddling fallback
+	template <SetOp OP>
+	inline void compare_words_popcnt(const uint64_t *a, const uint64_t *b, size_t n, uint64_t *out, SetCounts &c) {
+		compare_words<OP>(a, b, n, out, c);
+	}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+	// Nibble lookup popcount (Mula et al.): per-byte counts of four words at a time, summed into
+	// 64-bit lanes with vpsadbw before the 8-bit counters can overflow (31 steps of at most 8).
+	inline __m256i popcount_bytes(__m256i v) {
+		const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		const __m256i low = _mm256_set1_epi8(0x0f);
+		return _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(v, low)),
+			_mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+	}
+
+	inline __m256i apply_avx2(SetOp op, __m256i a, __m256i b) {
+		return op == UNION ? _mm256_or_si256(a, b) : op == INTERSECTION ? _mm256_and_si256(a, b)
+			: op == DIFFERENCE ? _mm256_andnot_si256(b, a) : _mm256_xor_si256(a, b);
+	}
+
+	inline uint64_t sum_lanes(__m256i v) {
+		uint64_t lanes[4];
+		_mm256_storeu_si256((__m256i*)lanes, v);
+		return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+
+	template <SetOp OP>
+	inline void compare_words_avx2(const uint64_t *a, const uint64_t *b, size_t n, uint64_t *out, SetCounts &c) {
+		const __m256i zero = _mm256_setzero_si256();
+		__m256i sum_a = zero, sum_b = zero, sum_both = zero;
+		size_t i = 0;
+		while (i + 4 <= n) {
+			const size_t end = std::min(n & ~(size_t)3, i + 4*31);
+			__m256i bytes_a = zero, bytes_b = zero, bytes_both = zero;
+			for (; i < end; i += 4) {
+				__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+				__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+				bytes_a = _mm256_add_epi8(bytes_a, popcount_bytes(va));
+				bytes_b = _mm256_add_epi8(bytes_b, popcount_bytes(vb));
+				bytes_both = _mm256_add_epi8(bytes_both, popcount_bytes(_mm256_and_si256(va, vb)));
+				if (out)
+					_mm256_storeu_si256((__m256i*)(out + i), apply_avx2(OP, va, vb));
+			}
+			sum_a = _mm256_add_epi64(sum_a, _mm256_sad_epu8(bytes_a, zero));
+			sum_b = _mm256_add_epi64(sum_b, _mm256_sad_epu8(bytes_b, zero));
+			sum_both = _mm256_add_epi64(sum_both, _mm256_sad_epu8(bytes_both, zero));
+		}
+		c.a += sum_lanes(sum_a);
+		c.b += sum_lanes(sum_b);
+		c.both += sum_lanes(sum_both);
+		compare_words_popcnt<OP>(a + i, b + i, n - i, out ? out + i : NULL, c);
+	}
+#pragma GCC pop_options
+#endif
+
+	template <SetOp OP>
+	inline SetCounts compare(const uint64_t *a, const uint64_t *b, size_t n_words, uint64_t *out) {
+		auto kernel = compare_words<OP>;
+#ifdef GRIDH_X86
+		if (__builtin_cpu_supports("avx2"))
+			kernel = compare_words_avx2<OP>;
+		else if (__builtin_cpu_supports("popcnt"))
+			kernel = compare_words_popcnt<OP>;
+#endif
+		// blocks of 32 KiB per grid, large enough to stream and small enough to balance
+		const size_t block = 4096;
+		const int64_t n_blocks = (n_words + block - 1)/block;
+		SetCounts total;
+		#pragma omp parallel
+		{
+			SetCounts c;
+			#pragma omp for schedule(static) nowait
+			for (int64_t k = 0; k < n_blocks; k++) {
+				const size_t begin = k*block, n = std::min(block, n_words - begin);
+				kernel(a + begin, b + begin, n, out ? out + begin : NULL, c);
+			}
+			#pragma omp critical
+			{
+				total.a += c.a;
+				total.b += c.b;
+				total.both += c.both;
+			}
+		}
+		return total;
+	}
+
+	// counts of a and b, and op(a, b) written to out (n_words words) unless it is NULL
+	inline SetCounts compare(const uint64_t *a, const uint64_t *b, size_t n_words, SetOp op = XOR, uint64_t *out = NULL) {
+		if (op == UNION)
+			return compare<UNION>(a, b, n_words, out);
+		if (op == INTERSECTION)
+			return compare<INTERSECTION>(a, b, n_words, out);
+		if (op == DIFFERENCE)
+			return compare<DIFFERENCE>(a, b, n_words, out);
+		return compare<XOR>(a, b, n_words, out);
+	}
+}
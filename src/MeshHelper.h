@@ -0,0 +1,484 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <Eigen/Dense>
+
+#include "tiny_obj_loader.h"
+#include "tinyply.h"
+
+namespace meshh {
+	struct Mesh {
+		Eigen::Matrix<float, -1, -1> V;
+		Eigen::Matrix<uint32_t, -1, -1> F;
+	};
+
+	// false (reason on stderr) for unknown formats, unreadable or empty files and out-of-range indices,
+	// so long-running callers (voxel_server, the library) can reject a file instead of stopping
+	inline bool try_load_mesh(const std::string &filename, Mesh &mesh) {
+		if (filename.find(".obj") != std::string::npos) {
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> materials;
+			std::string err;
+			if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str())) {
+				err.erase(err.find_last_not_of("\r\n") + 1);
+				fprintf(stderr, "Error: Could not read %s. %s\n", filename.c_str(), err.c_str());
+				return false;
+			}
+
+			std::vector<int> Ftmp;
+
+			// Loop over shapes
+			for (size_t s = 0; s < shapes.size(); s++) {
+				// Loop over faces(polygon)
+				size_t index_offset = 0;
+				for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
+					int fv = shapes[s].mesh.num_face_vertices[f];
+
+					// Loop over vertices in the face.
+					for (int v = 0; v < fv; v++) {
+						// access to vertex
+						Ftmp.push_back(shapes[s].mesh.indices[index_offset + v].vertex_index);
+					}
+					index_offset += fv;
+				}
+			}
+
+			mesh.F.resize(3, Ftmp.size()/3);
+			std::copy(Ftmp.begin(), Ftmp.end(), mesh.F.data());
+			mesh.V.resize(3, attrib.vertices.size()/3);
+			for (int i = 0; i < (int)attrib.vertices.size(); i++)
+				mesh.V(i) = attrib.vertices[i];
+
+			printf("n-faces: %d\n", (int)mesh.F.cols());
+			printf("n-verts: %d\n", (int)mesh.V.cols());
+
+		} else if (filename.find(".ply") != std::string::npos) {
+			std::ifstream ss(filename);
+			if (!ss.is_open()) {
+				fprintf(stderr, "Error: Could not read %s.\n", filename.c_str());
+				return false;
+			}
+			std::vector<float> verts;
+			std::vector<uint32_t> faces;
+			try {
+				tinyply::PlyFile file(ss);
+				int n_vertices = file.request_properties_from_element("vertex", { "x", "y", "z" }, verts);
+				// Try getting vertex_indices or vertex_index
+				int n_indices = file.request_properties_from_element("face", { "vertex_indices" }, faces, 3);
+				if (n_indices == 0)
+					n_indices = file.request_properties_from_element("face", { "vertex_index" }, faces, 3);
+				file.read(ss);
+				if (verts.size() != 3*(size_t)n_vertices || faces.size() != 3*(size_t)n_indices)
+					throw std::runtime_error("unexpected vertex or face layout");
+				mesh.V = Eigen::Map<Eigen::Matrix<float, -1, -1>>(verts.data(), 3, n_vertices);
+				mesh.F = Eigen::Map<Eigen::Matrix<uint32_t, -1, -1>>(faces.data(), 3, n_indices);
+			} catch (const std::exception &e) {
+				fprintf(stderr, "Error: Could not read %s: %s.\n", filename.c_str(), e.what());
+				return false;
+			}
+		} else {
+			fprintf(stderr, "Error: Mesh format not known.\n");
+			return false;
+		}
+		if (mesh.V.cols() == 0 || mesh.F.cols() == 0) {
+			fprintf(stderr, "Error: %s has no faces.\n", filename.c_str());
+			return false;
+		}
+		if (mesh.F.maxCoeff() >= (uint32_t)mesh.V.cols()) {
+			fprintf(stderr, "Error: %s has a vertex index out of range.\n", filename.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	inline void load_mesh(const std::string &filename, Mesh &mesh) {
+		if (!try_load_mesh(filename, mesh))
+			exit(1);
+	}
+
+	// binary .ply (through tinyply) or ascii .obj, chosen by the extension like load_mesh()
+	inline bool save_mesh(const std::string &filename, const Mesh &mesh) {
+		bool ply = filename.find(".ply") != std::string::npos;
+		if (!ply && filename.find(".obj") == std::string::npos) {
+			fprintf(stderr, "Error: Mesh format not known.\n");
+			return false;
+		}
+		std::ofstream out(filename, ply ? std::ios::out | std::ios::binary : std::ios::out);
+		if (!out.is_open()) {
+			fprintf(stderr, "Error: Could not write %s.\n", filename.c_str());
+			return false;
+		}
+		if (ply) {
+			std::vector<float> verts(mesh.V.data(), mesh.V.data() + mesh.V.size());
+			std::vector<uint32_t> faces(mesh.F.data(), mesh.F.data() + mesh.F.size());
+			tinyply::PlyFile file;
+			file.add_properties_to_element("vertex", { "x", "y", "z" }, verts);
+			file.add_properties_to_element("face", { "vertex_indices" }, faces, 3, tinyply::PlyProperty::Type::UINT8);
+			file.write(out, true);
+		} else {
+			for (int i = 0; i < mesh.V.cols(); i++)
+				out << "v " << mesh.V(0, i) << " " << mesh.V(1, i) << " " << mesh.V(2, i) << "\n";
+			for (int i = 0; i < mesh.F.cols(); i++)
+				out << "f " << mesh.F(0, i) + 1 << " " << mesh.F(1, i) + 1 << " " << mesh.F(2, i) + 1 << "\n";
+		}
+		return out.good();
+	}
+
+	// min corner and largest extent of the vertices, vertex v normalizes to (v - vmin)/dmax
+	inline void normalization(const Mesh &mesh, float vmin[3], float &dmax) {
+		float xmin = 1e9, xmax = 1e-9, ymin = 1e9, ymax = 1e-9, zmin = 1e9, zmax = 1e-9;
+		#pragma omp parallel for reduction(min: xmin, ymin, zmin) reduction(max: xmax, ymax, zmax)
+		for (int i = 0; i < mesh.V.cols(); i++) {
+			xmin = mesh.V(0, i) < xmin ? mesh.V(0, i) : xmin;
+			ymin = mesh.V(1, i) < ymin ? mesh.V(1, i) : ymin;
+			zmin = mesh.V(2, i) < zmin ? mesh.V(2, i) : zmin;
+			xmax = mesh.V(0, i) > xmax ? mesh.V(0, i) : xmax;
+			ymax = mesh.V(1, i) > ymax ? mesh.V(1, i) : ymax;
+			zmax = mesh.V(2, i) > zmax ? mesh.V(2, i) : zmax;
+		}
+
+		float dx = (xmax - xmin);
+		float dy = (ymax - ymin);
+		float dz = (zmax - zmin);
+		dmax = std::max(std::max(dx, dy), dz);
+		vmin[0] = xmin;
+		vmin[1] = ymin;
+		vmin[2] = zmin;
+	}
+
+	// scales the mesh uniformly into the unit cube [0, 1]^3 (anchored at the min corner)
+	inline void normalize_mesh(Mesh &mesh) {
+		float vmin[3], dmax;
+		normalization(mesh, vmin, dmax);
+
+		#pragma omp parallel for
+		for (int i = 0; i < mesh.V.cols(); i++) {
+			mesh.V(0, i) = (mesh.V(0, i) - vmin[0])/dmax;
+			mesh.V(1, i) = (mesh.V(1, i) - vmin[1])/dmax;
+			mesh.V(2, i) = (mesh.V(2, i) - vmin[2])/dmax;
+		}
+	}
+
+	struct CleanStats {
+		int n_verts_in = 0, n_verts_out = 0;
+		int n_faces_in = 0, n_faces_out = 0;
+		int n_degenerate = 0, n_duplicate = 0;
+	};
+
+	inline void print_clean_stats(const CleanStats &stats) {
+		printf("clean: n-verts %d -> %d, n-faces %d -> %d (%d degenerate, %d duplicate)\n", stats.n_verts_in, stats.n_verts_out,
+			stats.n_faces_in, stats.n_faces_out, stats.n_degenerate, stats.n_duplicate);
+	}
+
+	// Lock-free parallel deduplication: first[i] becomes the smallest j with equal(i, j). Ids are
+	// inserted into an open-addressing table where every slot keeps the smallest id of its key
+	// (atomic min), so the result does not depend on the thread count.
+	template <typename Hash, typename Equal>
+	inline void find_first_duplicates(int n, Hash hash, Equal equal, std::vector<uint32_t> &first) {
+		const uint32_t empty = 0xffffffff;
+		size_t size = 1;
+		while (size < 2*(size_t)n)
+			size <<= 1;
+		const size_t mask = size - 1;
+		std::vector<std::atomic<uint32_t>> table(size);
+		#pragma omp parallel for
+		for (int64_t s = 0; s < (int64_t)size; s++)
+			table[s].store(empty, std::memory_order_relaxed);
+
+		// first[i] holds the slot of i until all ids are in
+		first.resize(n);
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++) {
+			size_t s = hash(i) & mask;
+			for (;; s = (s + 1) & mask) {
+				uint32_t cur = table[s].load();
+				if (cur == empty && table[s].compare_exchange_strong(cur, i))
+					break;
+				if (equal(cur, i)) {
+					while ((uint32_t)i < cur && !table[s].compare_exchange_weak(cur, i));
+					break;
+				}
+			}
+			first[i] = s;
+		}
+
+		#pragma omp parallel for
+		for (int i = 0; i < n; i++)
+			first[i] = table[first[i]].load(std::memory_order_relaxed);
+	}
+
+
+	inline uint64_t hash_words(const uint32_t w[3]) {
+		uint64_t h = 0x9e3779b97f4a7c15ull;
+		for (int k = 0; k < 3; k++) {
+			h = (h ^ w[k])*0xff51afd7ed558ccdull;
+			h ^= h >> 32;
+		}
+		return h;
+	}
+
+	// Drop-in for normalize_mesh that also cleans scanned meshes and OBJ exports before upload:
+	// vertices with bitwise identical positions are welded, faces that collapse (a repeated vertex or
+	// a zero normal) are dropped, as are faces repeating the vertices of an earlier face in any order
+	// (they set the same voxels). Unreferenced vertices are removed and the survivors normalized
+	// while they are compacted. Kept vertices and faces stay in input order.
+	inline void normalize_clean_mesh(Mesh &mesh, CleanStats &stats) {
+		const int n_verts = mesh.V.cols(), n_faces = mesh.F.cols();
+		stats.n_verts_in = n_verts;
+		stats.n_faces_in = n_faces;
+		float vmin[3], dmax;
+		normalization(mesh, vmin, dmax);
+
+		// weld, every vertex maps to the smallest vertex id at its position
+		std::vector<uint32_t> weld;
+		find_first_duplicates(n_verts,
+			[&](int i) { uint32_t w[3]; memcpy(w, &mesh.V(0, i), sizeof(w)); return hash_words(w); },
+			[&](uint32_t a, uint32_t b) { return a < (uint32_t)n_verts && memcmp(&mesh.V(0, a), &mesh.V(0, b), 3*sizeof(float)) == 0; },
+			weld);
+
+		// faces as sorted welded vertex triples
+		std::vector<std::array<uint32_t, 3>> keys(n_faces);
+		std::vector<uint8_t> collapsed(n_faces);
+		#pragma omp parallel for
+		for (int i = 0; i < n_faces; i++) {
+			uint32_t a = weld[mesh.F(0, i)], b = weld[mesh.F(1, i)], c = weld[mesh.F(2, i)];
+			Eigen::Vector3f v0 = mesh.V.col(a), v1 = mesh.V.col(b), v2 = mesh.V.col(c);
+			collapsed[i] = a == b || b == c || c == a || (v1 - v0).cross(v2 - v1).isZero(0);
+			if (a > b) std::swap(a, b);
+			if (b > c) std::swap(b, c);
+			if (a > b) std::swap(a, b);
+			keys[i] = {a, b, c};
+		}
+		std::vector<uint32_t> first_face;
+		find_first_duplicates(n_faces,
+			[&](int i) { return hash_words(keys[i].data()); },
+			[&](uint32_t a, uint32_t b) { return a < (uint32_t)n_faces && keys[a] == keys[b]; },
+			first_face);
+
+		std::vector<uint8_t> keep(n_faces, 0), used(n_verts, 0);
+		stats.n_degenerate = stats.n_duplicate = 0;
+		for (int i = 0; i < n_faces; i++) {
+			if (collapsed[i]) {
+				stats.n_degenerate++;
+			} else if (first_face[i] != (uint32_t)i) {
+				stats.n_duplicate++;
+			} else {
+				keep[i] = 1;
+				used[keys[i][0]] = used[keys[i][1]] = used[keys[i][2]] = 1;
+			}
+		}
+
+		// compaction (prefix sums in input order), normalizing the kept vertices
+		std::vector<uint32_t> vertex_id(n_verts), face_id(n_faces);
+		uint32_t n_verts_out = 0, n_faces_out = 0;
+		for (int i = 0; i < n_verts; i++)
+			vertex_id[i] = used[i] ? n_verts_out++ : 0;
+		for (int i = 0; i < n_faces; i++)
+			face_id[i] = keep[i] ? n_faces_out++ : 0;
+
+		Mesh clean;
+		clean.V.resize(3, n_verts_out);
+		clean.F.resize(3, n_faces_out);
+		#pragma omp parallel for
+		for (int i = 0; i < n_verts; i++) {
+			if (!used[i])
+				continue;
+			for (int k = 0; k < 3; k++)
+				clean.V(k, vertex_id[i]) = (mesh.V(k, i) - vmin[k])/dmax;
+		}
+		#pragma omp parallel for
+		for (int i = 0; i < n_faces; i++) {
+			if (!keep[i])
+				continue;
+			for (int k = 0; k < 3; k++)
+				clean.F(k, face_id[i]) = vertex_id[weld[mesh.F(k, i)]];
+		}
+		mesh = std::move(clean);
+		stats.n_verts_out = n_verts_out;
+		stats.n_faces_out = n_faces_out;
+	}
+
+
+	// 1-to-4 midpoint subdivision, used to build synthetic dense meshes (the surface does not change)
+	inline void subdivide_mesh(Mesh &mesh, int n_levels) {
+		for (int level = 0; level < n_levels; level++) {
+			int n_verts = mesh.V.cols();
+			int n_faces = mesh.F.cols();
+			std::vector<float> V(mesh.V.data(), mesh.V.data() + 3*n_verts);
+			std::vector<uint32_t> F;
+			F.reserve(4*3*n_faces);
+			std::unordered_map<uint64_t, uint32_t> midpoints;
+
+			auto midpoint = [&](uint32_t a, uint32_t b) {
+				uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+				auto it = midpoints.find(key);
+				if (it != midpoints.end())
+					return it->second;
+				uint32_t id = V.size()/3;
+				for (int k = 0; k < 3; k++)
+					V.push_back(0.5f*(mesh.V(k, a) + mesh.V(k, b)));
+				midpoints[key] = id;
+				return id;
+			};
+
+			for (int i = 0; i < n_faces; i++) {
+				uint32_t a = mesh.F(0, i), b = mesh.F(1, i), c = mesh.F(2, i);
+				uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+				uint32_t tris[12] = {a, ab, ca,  ab, b, bc,  ca, bc, c,  ab, bc, ca};
+				F.insert(F.end(), tris, tris + 12);
+			}
+
+			mesh.V = Eigen::Map<Eigen::Matrix<float, -1, -1>>(V.data(), 3, V.size()/3);
+			mesh.F = Eigen::Map<Eigen::Matrix<uint32_t, -1, -1>>(F.data(), 3, F.size()/3);
+		}
+	}
+
+	// renumbers the vertices in the order the faces first use them (unused ones are dropped), which
+	// keeps the vertex indices of consecutive faces close together, e.g. after subdivide_mesh
+	inline void reorder_vertices(Mesh &mesh) {
+		const uint32_t UNSEEN = ~0u;
+		std::vector<uint32_t> vertex_id(mesh.V.cols(), UNSEEN);
+		uint32_t n_verts = 0;
+		for (int j = 0; j < (int)mesh.F.size(); j++) {
+			uint32_t &id = vertex_id[mesh.F.data()[j]];
+			if (id == UNSEEN)
+				id = n_verts++;
+			mesh.F.data()[j] = id;
+		}
+		Eigen::Matrix<float, -1, -1> V(mesh.V.rows(), n_verts);
+		for (int i = 0; i < (int)vertex_id.size(); i++)
+			if (vertex_id[i] != UNSEEN)
+				V.col(vertex_id[i]) = mesh.V.col(i);
+		mesh.V.swap(V);
+	}
+
+	// Meshlets are runs of consecutive faces whose vertex indices span at most 2^16 - 1, so that each
+	// can be drawn with 16-bit indices relative to its smallest vertex (glDrawElementsBaseVertex).
+	struct Meshlet {
+		uint32_t first_face, n_faces, base_vertex;
+	};
+
+	// meshlets with fewer faces on average are not worth the extra draws, the faces then stay 32-bit
+	const int MIN_MESHLET_FACES = 256;
+
+	// splits faces[0, 3*nFaces) greedily into meshlets, returns false if the vertex order is too scattered
+	inline bool build_meshlets(const uint32_t *faces, int nFaces, std::vector<uint16_t> &indices, std::vector<Meshlet> &meshlets) {
+		meshlets.clear();
+		uint32_t lo = 0, hi = 0;
+		for (int i = 0; i < nFaces; i++) {
+			const uint32_t *f = faces + 3*i;
+			uint32_t flo = std::min(std::min(f[0], f[1]), f[2]), fhi = std::max(std::max(f[0], f[1]), f[2]);
+			if (meshlets.empty() || std::max(hi, fhi) - std::min(lo, flo) > 0xffff) {
+				if (meshlets.size() > (size_t)nFaces/MIN_MESHLET_FACES)
+					return false;
+				if (!meshlets.empty())
+					meshlets.back().base_vertex = lo;
+				meshlets.push_back({(uint32_t)i, 0, 0});
+				lo = flo;
+				hi = fhi;
+			}
+			lo = std::min(lo, flo);
+			hi = std::max(hi, fhi);
+			meshlets.back().n_faces++;
+		}
+		if (!meshlets.empty())
+			meshlets.back().base_vertex = lo;
+
+		indices.resize(3*(size_t)nFaces);
+		for (const Meshlet &m : meshlets)
+			for (size_t j = 3*(size_t)m.first_face; j < 3*(size_t)(m.first_face + m.n_faces); j++)
+				indices[j] = faces[j] - m.base_vertex;
+		return true;
+	}
+
+	// Several meshes merged into one, object i owns the faces [object_faces[i], object_faces[i + 1]).
+	// Objects are labeled i + 1 in label grids, 0 is empty.
+	struct Scene {
+		Mesh mesh;
+		std::vector<uint32_t> object_faces;
+
+		int n_objects() const {
+			return (int)object_faces.size() - 1;
+		}
+	};
+
+	const int MAX_SCENE_OBJECTS = 65535; // labels are uint16
+
+	// .scene file: one object per line, "<mesh> [m00 m01 m02 m03 m10 ... m23]" with an optional
+	// row-major 3x4 affine transform (identity by default). Relative mesh paths are taken from the
+	// directory of the scene file, '#' starts a comment.
+	inline bool load_scene(const std::string &filename, Scene &scene) {
+		std::ifstream in(filename);
+		if (!in.is_open()) {
+			fprintf(stderr, "Error: Could not read %s.\n", filename.c_str());
+			return false;
+		}
+		size_t slash = filename.find_last_of('/');
+		std::string dir = slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+
+		std::vector<Mesh> objects;
+		std::vector<Eigen::Matrix<float, 3, 4>> transforms;
+		std::string line;
+		while (std::getline(in, line)) {
+			line = line.substr(0, line.find('#'));
+			std::istringstream ls(line);
+			std::string path;
+			if (!(ls >> path))
+				continue;
+			Eigen::Matrix<float, 3, 4> T = Eigen::Matrix<float, 3, 4>::Identity();
+			float m[12];
+			int n = 0;
+			while (n < 12 && ls >> m[n])
+				n++;
+			if (n == 12) {
+				T = Eigen::Map<Eigen::Matrix<float, 3, 4, Eigen::RowMajor>>(m);
+			} else if (n != 0) {
+				fprintf(stderr, "Error: %s: the transform of %s needs 12 numbers.\n", filename.c_str(), path.c_str());
+				return false;
+			}
+			objects.emplace_back();
+			if (!try_load_mesh(path[0] == '/' ? path : dir + path, objects.back()))
+				return false;
+			transforms.push_back(T);
+		}
+		if (objects.empty() || (int)objects.size() > MAX_SCENE_OBJECTS) {
+			fprintf(stderr, "Error: %s must list 1 to %d meshes.\n", filename.c_str(), MAX_SCENE_OBJECTS);
+			return false;
+		}
+
+		int n_verts = 0, n_faces = 0;
+		for (const Mesh &o : objects) {
+			n_verts += o.V.cols();
+			n_faces += o.F.cols();
+		}
+		scene.mesh.V.resize(3, n_verts);
+		scene.mesh.F.resize(3, n_faces);
+		scene.object_faces.assign(1, 0);
+		n_verts = 0;
+		n_faces = 0;
+		for (size_t i = 0; i < objects.size(); i++) {
+			const Mesh &o = objects[i];
+			scene.mesh.V.middleCols(n_verts, o.V.cols()) = (transforms[i].leftCols<3>()*o.V).colwise() + transforms[i].col(3);
+			scene.mesh.F.middleCols(n_faces, o.F.cols()) = o.F.array() + (uint32_t)n_verts;
+			n_verts += o.V.cols();
+			n_faces += o.F.cols();
+			scene.object_faces.push_back(n_faces);
+		}
+		printf("n-objects: %d\n", scene.n_objects());
+		return true;
+	}
+}
@@ -1,7 +1,12 @@
+#pragma once
 
 #define GLEW_STATIC
 
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <glm/glm.hpp>
 #include <GL/glew.h>
+
 #include <GLFW/glfw3.h>
 #include <stdlib.h>
 #include <stdexcept>
@@ -68,7 +73,7 @@ namespace oglh {
 	  return tr.matrix();
 	}
 
-	void init_gl(std::string title, int width, int height, GLFWwindow **window) {
+	void init_gl(std::string title, int width, int height, GLFWwindow **window, bool visible = true) {
 		if (!glfwInit())
 	            throw std::runtime_error("glfwInit failed");
 	
@@ -77,6 +82,8 @@ namespace oglh {
 	        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
 	        glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	        glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
+
 	        
 			*window = glfwCreateWindow(width, height, title.c_str(), NULL, NULL);
 	        if (!*window)
@@ -133,11 +140,18 @@ namespace oglh {
 		glfwTerminate();
 	}
 
-	void load_shader(GLuint &id, std::string path, GLenum type) {
+	// defines (e.g. "#define THICKNESS FAT\n") are inserted right after the #version line
+	void load_shader(GLuint &id, std::string path, GLenum type, std::string defines = "") {
 		id = glCreateShader(type);
 		
 		std::string src0;
 		load_text_from_file(path, src0);
+		if (!defines.empty()) {
+			size_t pos = src0.find("#version");
+			pos = pos == std::string::npos ? 0 : src0.find('\n', pos) + 1;
+			src0.insert(pos, defines);
+		}
+
 		const char* src = src0.c_str();
 		glShaderSource(id, 1, &src, NULL);
 		
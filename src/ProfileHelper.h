@@ -0,0 +1,148 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <cassert>
+
+#include <GL/glew.h>
+
+// Opt-in stage timing. Host stages are measured with steady_clock, GPU stages with
+// GL_TIME_ELAPSED queries (which cannot nest, so GPU scopes must not overlap). Nothing is
+// recorded and no GL objects are created unless the profiler was enabled.
+namespace profh {
+	typedef std::chrono::steady_clock clock;
+
+	struct Event {
+		std::string name;
+		std::string category; // "host" or "gpu"
+		double begin_us;      // relative to enable(); GPU events use the host submission time
+		double duration_us;
+	};
+
+	class Profiler {
+	public:
+		void enable() {
+			enabled = true;
+			t_origin = clock::now();
+		}
+
+		bool is_enabled() const {
+			return enabled;
+		}
+
+		double now_us() const {
+			return std::chrono::duration<double, std::micro>(clock::now() - t_origin).count();
+		}
+
+		void add_host(const std::string &name, double begin_us, double end_us) {
+			if (!enabled)
+				return;
+			events.push_back({name, "host", begin_us, end_us - begin_us});
+		}
+
+		void begin_gpu(const std::string &name) {
+			if (!enabled)
+				return;
+			GpuQuery q;
+			q.name = name;
+			q.begin_us = now_us();
+			glGenQueries(1, &q.id);
+			glBeginQuery(GL_TIME_ELAPSED, q.id);
+			pending.push_back(q);
+		}
+
+		void end_gpu() {
+			if (!enabled)
+				return;
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+
+		// waits for all outstanding GPU queries and turns them into events
+		void resolve() {
+			for (auto &q : pending) {
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(q.id, GL_QUERY_RESULT, &ns);
+				glDeleteQueries(1, &q.id);
+				events.push_back({q.name, "gpu", q.begin_us, ns*1e-3});
+			}
+			pending.clear();
+		}
+
+		// aggregated per stage: count, total and mean in milliseconds
+		void write_report(FILE *out) const {
+			struct Stat { int count = 0; double total_us = 0; };
+			std::map<std::pair<std::string, std::string>, Stat> stats;
+			for (auto &e : events) {
+				Stat &s = stats[{e.category, e.name}];
+				s.count++;
+				s.total_us += e.duration_us;
+			}
+			fprintf(out, "%-6s %-24s %8s %12s %12s\n", "", "stage", "count", "total [ms]", "mean [ms]");
+			for (auto &kv : stats)
+				fprintf(out, "%-6s %-24s %8d %12.3f %12.3f\n", kv.first.first.c_str(), kv.first.second.c_str(),
+						kv.second.count, kv.second.total_us*1e-3, kv.second.total_us*1e-3/kv.second.count);
+		}
+
+		// Chrome trace event format (chrome://tracing, Perfetto); host and GPU stages go on separate tracks
+		void write_chrome_trace(const std::string &filename) const {
+			std::ofstream out(filename, std::ios::out);
+			assert(out.is_open());
+			out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+			for (size_t i = 0; i < events.size(); i++) {
+				const Event &e = events[i];
+				out << "  {\"name\": \"" << e.name << "\", \"cat\": \"" << e.category << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": "
+					<< (e.category == "gpu" ? 1 : 0) << ", \"ts\": " << e.begin_us << ", \"dur\": " << e.duration_us << "}"
+					<< (i + 1 < events.size() ? "," : "") << "\n";
+			}
+			out << "]}\n";
+			out.close();
+		}
+
+		const std::vector<Event> &get_events() const {
+			return events;
+		}
+
+	private:
+		struct GpuQuery {
+			std::string name;
+			GLuint id;
+			double begin_us;
+		};
+
+		bool enabled = false;
+		clock::time_point t_origin;
+		std::vector<GpuQuery> pending;
+		std::vector<Event> events;
+	};
+
+	// process-wide profiler used by the scopes below
+	inline Profiler &get() {
+		static Profiler profiler;
+		return profiler;
+	}
+
+	class HostScope {
+	public:
+		HostScope(const std::string &name) : name(name), begin_us(get().now_us()) {}
+		~HostScope() {
+			get().add_host(name, begin_us, get().now_us());
+		}
+	private:
+		std::string name;
+		double begin_us;
+	};
+
+	class GpuScope {
+	public:
+		GpuScope(const std::string &name) {
+			get().begin_gpu(name);
+		}
+		~GpuScope() {
+			get().end_gpu();
+		}
+	};
+}
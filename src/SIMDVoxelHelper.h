@@ -0,0 +1,152 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SIMDVOXH_X86 1
+#endif
+
+// Runtime-dispatched per-cell kernel of the CPU voxelizer (small triangles, see
+// cpuvoxh::voxelize_triangle). The scalar, AVX2 and AVX-512 versions evaluate the same float
+// expressions in the same order (and the build disables FMA contraction), so all of them produce
+// exactly the grid of the scalar loop. The vector kernels hold 8 or 16 cells of a column: first
+// along y for the xy edge tests and the plane z-range, then along z for the yz/zx z-column test.
+namespace simdvoxh {
+	enum Level { SCALAR = 0, AVX2 = 1, AVX512 = 2 };
+
+	// edge functions and plane of a swizzled triangle (names as in VoxelizationGS.glsl)
+	struct CellSetup {
+		float n_xy[3][2], n_yz[3][2], n_zx[3][2];
+		float d_xy[3], d_yz[3], d_zx[3];
+		float nProj[2];
+		float dTriMin, dTriMax; // the same plane offset in THIN mode
+		float nzInv;
+		int min[3], max[3]; // voxel bounding box [min, max), swizzled
+		size_t step[3]; // grid index step of each swizzled axis
+	};
+
+	inline const char *level_name(Level level) {
+		return level == AVX512 ? "avx512" : level == AVX2 ? "avx2" : "scalar";
+	}
+
+	inline bool parse_level(const std::string &name, Level &level) {
+		for (Level l : {SCALAR, AVX2, AVX512}) {
+			if (name == level_name(l)) {
+				level = l;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// best level supported by this CPU
+	inline Level detect() {
+#ifdef SIMDVOXH_X86
+		if (__builtin_cpu_supports("avx512f"))
+			return AVX512;
+		if (__builtin_cpu_supports("avx2"))
+			return AVX2;
+#endif
+		return SCALAR;
+	}
+
+	// kernel used by voxelize_cells, the best supported one unless set otherwise (benchmarks)
+	inline Level &level() {
+		static Level l = detect();
+		return l;
+	}
+
+	inline void voxelize_cells_scalar(const CellSetup &c, uint8_t *image) {
+		auto dot2 = [](float ax, float ay, float bx, float by) { return ax*bx + ay*by; };
+		for (int x = c.min[0]; x < c.max[0]; x++) {
+			for (int y = c.min[1]; y < c.max[1]; y++) {
+				bool xy_overlap = true;
+				for (int i = 0; i < 3; i++)
+					xy_overlap = xy_overlap && (c.d_xy[i] + dot2(c.n_xy[i][0], c.n_xy[i][1], x, y) >= 0);
+				if (!xy_overlap)
+					continue;
+
+				float dot_n_p = dot2(c.nProj[0], c.nProj[1], x, y);
+				float zMinInt = (-dot_n_p + c.dTriMin)*c.nzInv;
+				float zMaxInt = (-dot_n_p + c.dTriMax)*c.nzInv;
+				float zMinFloor = std::floor(zMinInt);
+				float zMaxCeil  = std::ceil(zMaxInt);
+
+				int zMin = std::max(c.min[2], (int)zMinFloor - (int)(zMinFloor == zMinInt));
+				int zMax = std::min(c.max[2], (int)zMaxCeil  + (int)(zMaxCeil  == zMaxInt));
+
+				for (int z = zMin; z < zMax; z++) {
+					bool yz_overlap = true, zx_overlap = true;
+					for (int i = 0; i < 3; i++) {
+						yz_overlap = yz_overlap && (c.d_yz[i] + dot2(c.n_yz[i][0], c.n_yz[i][1], y, z) >= 0);
+						zx_overlap = zx_overlap && (c.d_zx[i] + dot2(c.n_zx[i][0], c.n_zx[i][1], z, x) >= 0);
+					}
+					if (yz_overlap && zx_overlap)
+						image[x*c.step[0] + y*c.step[1] + z*c.step[2]] = 1;
+				}
+			}
+		}
+	}
+
+#ifdef SIMDVOXH_X86
+#pragma GCC push_options
+#pragma GCC target("avx2")
+	namespace avx2 {
+		typedef __m256 F;
+		const int W = 8;
+		inline F set1(float a) { return _mm256_set1_ps(a); }
+		inline F lanes() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+		inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+		inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+		inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+		inline F floor(F a) { return _mm256_floor_ps(a); }
+		inline F ceil(F a) { return _mm256_ceil_ps(a); }
+		inline unsigned ge(F a, F b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ)); }
+		inline unsigned eq(F a, F b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+		inline void store_int(int *p, F a) { _mm256_storeu_si256((__m256i*)p, _mm256_cvttps_epi32(a)); }
+		inline unsigned first_lanes(int n) { return n >= W ? (1u << W) - 1 : (1u << n) - 1; }
+#include "SIMDVoxelKernel.h"
+	}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+	namespace avx512 {
+		typedef __m512 F;
+		const int W = 16;
+		inline F set1(float a) { return _mm512_set1_ps(a); }
+		inline F lanes() { return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+		inline F add(F a, F b) { return _mm512_add_ps(a, b); }
+		inline F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+		inline F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+		inline F floor(F a) { return _mm512_maskz_roundscale_ps(0xffff, a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+		inline F ceil(F a) { return _mm512_maskz_roundscale_ps(0xffff, a, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+		inline unsigned ge(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+		inline unsigned eq(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+		inline void store_int(int *p, F a) { _mm512_storeu_si512(p, _mm512_maskz_cvttps_epi32(0xffff, a)); }
+		inline unsigned first_lanes(int n) { return n >= W ? (1u << W) - 1 : (1u << n) - 1; }
+#include "SIMDVoxelKernel.h"
+	}
+#pragma GCC pop_options
+#endif
+
+	inline void voxelize_cells(const CellSetup &c, uint8_t *image) {
+		switch (level()) {
+#ifdef SIMDVOXH_X86
+		case AVX512:
+			avx512::voxelize_cells(c, image);
+			break;
+		case AVX2:
+			avx2::voxelize_cells(c, image);
+			break;
+#endif
+		default:
+			voxelize_cells_scalar(c, image);
+		}
+	}
+}
@@ -0,0 +1,65 @@
+// Per-cell voxelization kernel of SIMDVoxelHelper.h. No include guard on purpose: this body is
+// included once per instruction set, inside a namespace that provides the vector type F, its lane
+// count W and the operations used below, and compiled for that target.
+
+// edge tests and plane z-range of the y-cells [y0, y0 + W) of column x, then the yz/zx test of
+// every z-run, W z-cells at a time. Same expressions as the scalar loop, in the same order.
+inline void voxelize_cells(const CellSetup &c, uint8_t *image) {
+	const F iota = lanes();
+	const F zero = set1(0.0f);
+	F n_xy[3][2], n_yz[3][2], n_zx[3][2], d_xy[3], d_yz[3], d_zx[3];
+	for (int i = 0; i < 3; i++) {
+		for (int k = 0; k < 2; k++) {
+			n_xy[i][k] = set1(c.n_xy[i][k]);
+			n_yz[i][k] = set1(c.n_yz[i][k]);
+			n_zx[i][k] = set1(c.n_zx[i][k]);
+		}
+		d_xy[i] = set1(c.d_xy[i]);
+		d_yz[i] = set1(c.d_yz[i]);
+		d_zx[i] = set1(c.d_zx[i]);
+	}
+	const F nProjX = set1(c.nProj[0]), nProjY = set1(c.nProj[1]);
+	const F dTriMin = set1(c.dTriMin), dTriMax = set1(c.dTriMax), nzInv = set1(c.nzInv);
+
+	int zMinLane[W], zMaxLane[W];
+	for (int x = c.min[0]; x < c.max[0]; x++) {
+		const F xf = set1((float)x);
+		for (int y0 = c.min[1]; y0 < c.max[1]; y0 += W) {
+			const F yf = add(set1((float)y0), iota);
+			unsigned pass = first_lanes(c.max[1] - y0);
+			for (int i = 0; i < 3; i++)
+				pass &= ge(add(d_xy[i], add(mul(n_xy[i][0], xf), mul(n_xy[i][1], yf))), zero);
+			if (!pass)
+				continue;
+
+			// -dot_n_p + dTri is computed as dTri - dot_n_p, which IEEE defines identically
+			const F dot_n_p = add(mul(nProjX, xf), mul(nProjY, yf));
+			const F zMinInt = mul(sub(dTriMin, dot_n_p), nzInv);
+			const F zMaxInt = mul(sub(dTriMax, dot_n_p), nzInv);
+			const F zMinFloor = floor(zMinInt);
+			const F zMaxCeil = ceil(zMaxInt);
+			store_int(zMinLane, zMinFloor);
+			store_int(zMaxLane, zMaxCeil);
+			const unsigned zMinOnBoundary = eq(zMinFloor, zMinInt), zMaxOnBoundary = eq(zMaxCeil, zMaxInt);
+
+			for (; pass; pass &= pass - 1) {
+				const int l = __builtin_ctz(pass);
+				const int y = y0 + l;
+				const int zMin = std::max(c.min[2], zMinLane[l] - (int)((zMinOnBoundary >> l) & 1));
+				const int zMax = std::min(c.max[2], zMaxLane[l] + (int)((zMaxOnBoundary >> l) & 1));
+				const F yv = set1((float)y);
+				const size_t base = x*c.step[0] + y*c.step[1];
+				for (int z0 = zMin; z0 < zMax; z0 += W) {
+					const F zf = add(set1((float)z0), iota);
+					unsigned overlap = first_lanes(zMax - z0);
+					for (int i = 0; i < 3; i++) {
+						overlap &= ge(add(d_yz[i], add(mul(n_yz[i][0], yv), mul(n_yz[i][1], zf))), zero);
+						overlap &= ge(add(d_zx[i], add(mul(n_zx[i][0], zf), mul(n_zx[i][1], xf))), zero);
+					}
+					for (; overlap; overlap &= overlap - 1)
+						image[base + (z0 + __builtin_ctz(overlap))*c.step[2]] = 1;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,386 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include <Eigen/Dense>
+
+#include "MeshHelper.h"
+
+// Surface extraction from dense occupancy grids (x fastest, as read back from the GPU). Meshes
+// come out in the unit cube the input was voxelized in: voxel (x, y, z) spans [x, x + 1)/dimx,
+// [y, y + 1)/dimy, [z, z + 1)/dimz, and triangles wind counter-clockwise seen from outside.
+namespace surfh {
+	// rectangle of coplanar exposed faces, [u0, u1) x [v0, v1) along axes (axis + 1) % 3 and
+	// (axis + 2) % 3, lying on grid plane `plane` of `axis` and facing +axis (side 1) or -axis (side 0)
+	struct Quad {
+		int axis, side, plane;
+		int u0, v0, u1, v1;
+	};
+
+	// merges the set cells of a nu x nv mask (u fastest) into maximal rows, then stacks equal rows
+	// along v; the mask is cleared
+	inline void greedy_rectangles(uint8_t *mask, int nu, int nv, Quad q, std::vector<Quad> &quads) {
+		for (int v = 0; v < nv; v++) {
+			for (int u = 0; u < nu; ) {
+				if (!mask[(size_t)v*nu + u]) {
+					u++;
+					continue;
+				}
+				int w = 1;
+				while (u + w < nu && mask[(size_t)v*nu + u + w])
+					w++;
+				int h = 1;
+				for (; v + h < nv; h++) {
+					const uint8_t *row = &mask[(size_t)(v + h)*nu + u];
+					if (std::find(row, row + w, 0) != row + w)
+						break;
+				}
+				for (int j = v; j < v + h; j++)
+					std::fill_n(&mask[(size_t)j*nu + u], w, 0);
+				q.u0 = u;
+				q.v0 = v;
+				q.u1 = u + w;
+				q.v1 = v + h;
+				quads.push_back(q);
+				u += w;
+			}
+		}
+	}
+
+	// x slices are masked SLAB at a time, so that a row of the grid is read once per slab instead of
+	// once per slice (one byte of every cache line)
+	const int SLAB = 16;
+
+	// Greedy meshing. Every slice of every axis and side is masked with the faces whose neighbour
+	// is empty or outside the grid and merged into rectangles, slabs of slices in parallel. The
+	// surface is closed, but merged rectangles meet with T-junctions. Returns the quad count.
+	inline int greedy_quads(const uint8_t *image, const int voxelResolution[3], std::vector<Quad> &quads) {
+		const size_t step[3] = {1, (size_t)voxelResolution[0], (size_t)voxelResolution[0]*voxelResolution[1]};
+		// slab k is (axis, side, first plane), one slice thick along y and z
+		std::vector<Eigen::Vector3i> slabs;
+		for (int axis = 0; axis < 3; axis++)
+			for (int side = 0; side < 2; side++)
+				for (int s = 0; s < voxelResolution[axis]; s += axis == 0 ? SLAB : 1)
+					slabs.emplace_back(axis, side, s);
+
+		std::vector<std::vector<Quad>> out(slabs.size());
+		#pragma omp parallel
+		{
+			std::vector<uint8_t> mask;
+			#pragma omp for schedule(dynamic, 4)
+			for (int k = 0; k < (int)slabs.size(); k++) {
+				const int axis = slabs[k][0], side = slabs[k][1], s0 = slabs[k][2];
+				const int n_slices = std::min(axis == 0 ? SLAB : 1, voxelResolution[axis] - s0);
+				const int ua = (axis + 1) % 3, va = (axis + 2) % 3;
+				const int nu = voxelResolution[ua], nv = voxelResolution[va];
+				const size_t n_cells = (size_t)nu*nv;
+				const size_t mask_stride = n_cells + 64; // slices a power of two apart would alias in the cache
+				const ptrdiff_t neighbour = side ? (ptrdiff_t)step[axis] : -(ptrdiff_t)step[axis];
+				mask.assign(n_slices*mask_stride, 0);
+				if (axis == 0) {
+					// rows along x: SLAB consecutive bytes give one cell of every slice of the slab
+					for (int z = 0; z < nv; z++) {
+						for (int y = 0; y < nu; y++) {
+							const uint8_t *cell = image + z*step[2] + y*step[1] + s0;
+							if (n_slices == SLAB && std::none_of(cell, cell + SLAB, [](uint8_t c) { return c != 0; }))
+								continue;
+							uint8_t *m = &mask[(size_t)z*nu + y];
+							for (int j = 0; j < n_slices; j++) {
+								const int s = s0 + j;
+								const bool boundary = side ? s + 1 == voxelResolution[0] : s == 0;
+								m[j*mask_stride] = cell[j] && (boundary || !cell[j + neighbour]);
+							}
+						}
+					}
+				} else {
+					// walk the slice with the in-plane axis of smaller grid step innermost
+					const bool boundary = side ? s0 + 1 == voxelResolution[axis] : s0 == 0;
+					const bool u_inner = step[ua] < step[va];
+					const int n_outer = u_inner ? nv : nu, n_inner = u_inner ? nu : nv;
+					const size_t outer_step = u_inner ? step[va] : step[ua], inner_step = u_inner ? step[ua] : step[va];
+					const size_t mask_outer = u_inner ? nu : 1, mask_inner = u_inner ? 1 : nu;
+					for (int o = 0; o < n_outer; o++) {
+						const uint8_t *row = image + s0*step[axis] + o*outer_step;
+						uint8_t *mask_row = &mask[o*mask_outer];
+						for (int i = 0; i < n_inner; i++) {
+							const uint8_t *cell = row + i*inner_step;
+							mask_row[i*mask_inner] = *cell && (boundary || !cell[neighbour]);
+						}
+					}
+				}
+				for (int j = 0; j < n_slices; j++) {
+					std::vector<uint8_t>::iterator begin = mask.begin() + j*mask_stride;
+					if (std::find(begin, begin + n_cells, 1) == begin + n_cells)
+						continue;
+					Quad q;
+					q.axis = axis;
+					q.side = side;
+					q.plane = s0 + j + side;
+					greedy_rectangles(&mask[j*mask_stride], nu, nv, q, out[k]);
+				}
+			}
+		}
+		quads.clear();
+		for (const std::vector<Quad> &o : out)
+			quads.insert(quads.end(), o.begin(), o.end());
+		return quads.size();
+	}
+
+	// two triangles per quad. Quad corners shared by several quads become one vertex, so the mesh
+	// is connected wherever corners meet (not across T-junctions).
+	inline void quads_to_mesh(const std::vector<Quad> &quads, const int voxelResolution[3], meshh::Mesh &mesh) {
+		const uint64_t stride[3] = {1, (uint64_t)voxelResolution[0] + 1, ((uint64_t)voxelResolution[0] + 1)*(voxelResolution[1] + 1)};
+		auto corner = [&](const Quad &q, int u, int v) {
+			int p[3];
+			p[q.axis] = q.plane;
+			p[(q.axis + 1) % 3] = u;
+			p[(q.axis + 2) % 3] = v;
+			return p[0]*stride[0] + p[1]*stride[1] + p[2]*stride[2];
+		};
+		// counter-clockwise seen from +axis, mirrored for -axis
+		auto corners = [&](const Quad &q, uint64_t c[4]) {
+			c[0] = corner(q, q.u0, q.v0);
+			c[1] = corner(q, q.u1, q.v0);
+			c[2] = corner(q, q.u1, q.v1);
+			c[3] = corner(q, q.u0, q.v1);
+			if (!q.side)
+				std::swap(c[1], c[3]);
+		};
+
+		std::vector<uint64_t> keys(4*quads.size());
+		#pragma omp parallel for
+		for (int i = 0; i < (int)quads.size(); i++)
+			corners(quads[i], &keys[4*(size_t)i]);
+		std::vector<uint64_t> unique = keys;
+		std::sort(unique.begin(), unique.end());
+		unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+
+		mesh.V.resize(3, unique.size());
+		#pragma omp parallel for
+		for (int i = 0; i < (int)unique.size(); i++) {
+			uint64_t key = unique[i];
+			for (int k = 2; k >= 0; k--) {
+				mesh.V(k, i) = (float)(key/stride[k])/voxelResolution[k];
+				key %= stride[k];
+			}
+		}
+
+		mesh.F.resize(3, 2*quads.size());
+		#pragma omp parallel for
+		for (int i = 0; i < (int)quads.size(); i++) {
+			uint32_t id[4];
+			for (int k = 0; k < 4; k++)
+				id[k] = std::lower_bound(unique.begin(), unique.end(), keys[4*(size_t)i + k]) - unique.begin();
+			mesh.F.col(2*i) << id[0], id[1], id[2];
+			mesh.F.col(2*i + 1) << id[0], id[2], id[3];
+		}
+	}
+
+	inline void greedy_mesh(const uint8_t *image, const int voxelResolution[3], meshh::Mesh &mesh) {
+		std::vector<Quad> quads;
+		greedy_quads(image, voxelResolution, quads);
+		quads_to_mesh(quads, voxelResolution, mesh);
+	}
+
+	// Surface nets (Gibson, "Constrained elastic surface nets", 1998) over the occupancy grid. The
+	// samples are the voxel centres, with an empty layer around the grid. Every cell of 2x2x2 samples
+	// with inside and outside corners gets a vertex at the mean of its crossing edges' midpoints,
+	// and every crossing edge a quad between the vertices of its four cells. The vertices are then
+	// relaxed towards the mean of their neighbours, each kept within its cell, which smooths the
+	// staircase but keeps the topology of the grid: the mesh is closed and faces outwards.
+	//
+	// Cell layers are processed in slabs of SLAB layers in parallel, each with a thread-local cache of
+	// the vertex ids of its last two layers. Quads of a slab's first layer refer to the previous slab
+	// by cell and are resolved once all vertex counts are known. The output does not depend on the
+	// thread count.
+	inline void surface_nets(const uint8_t *image, const int voxelResolution[3], meshh::Mesh &mesh, int iterations = 10) {
+		const int nx = voxelResolution[0], ny = voxelResolution[1], nz = voxelResolution[2];
+		// sample layer z with the empty border, (nx + 2) x (ny + 2) starting at sample (-1, -1)
+		const size_t row = nx + 2;
+		auto load_layer = [&](int z, std::vector<uint8_t> &layer) {
+			layer.assign(row*(ny + 2), 0);
+			if (z < 0 || z >= nz)
+				return;
+			for (int y = 0; y < ny; y++) {
+				const uint8_t *src = image + ((size_t)z*ny + y)*nx;
+				uint8_t *dst = &layer[(y + 1)*row + 1];
+				for (int x = 0; x < nx; x++)
+					dst[x] = src[x] != 0;
+			}
+		};
+		// cells are named by their min sample, -1 to n - 1 along every axis
+		const size_t layer_size = (size_t)(nx + 1)*(ny + 1);
+		auto cell_id = [&](int x, int y) { return (size_t)(y + 1)*(nx + 1) + (x + 1); };
+
+		struct Slab {
+			std::vector<float> V;      // voxel units
+			std::vector<int32_t> cell; // min sample of the cell of every vertex
+			std::vector<int64_t> quads; // local vertex, or -1 - cell id in the last layer of the previous slab
+			std::vector<std::pair<int32_t, int32_t>> last; // (cell id, local vertex) of the last layer, by cell id
+		};
+		const int n_layers = nz + 1;
+		std::vector<Slab> slabs((n_layers + SLAB - 1)/SLAB);
+
+		#pragma omp parallel
+		{
+			std::vector<int64_t> prev(layer_size), cur(layer_size);
+			std::vector<uint8_t> lo, hi; // sample layers z and z + 1
+			#pragma omp for schedule(dynamic, 1)
+			for (int k = 0; k < (int)slabs.size(); k++) {
+				Slab &slab = slabs[k];
+				const int z0 = k*SLAB - 1, z1 = std::min(z0 + SLAB, nz);
+				for (size_t i = 0; i < layer_size; i++)
+					cur[i] = -1 - (int64_t)i;
+				load_layer(z0, hi);
+				for (int z = z0; z < z1; z++) {
+					std::swap(prev, cur);
+					std::fill(cur.begin(), cur.end(), -1);
+					std::swap(lo, hi);
+					load_layer(z + 1, hi);
+					// sample (x, y, z + k) for x, y >= -1
+					auto inside = [&](int x, int y, int k) { return (k ? hi : lo)[(y + 1)*row + x + 1]; };
+					// -> vertices of cell layer z
+					for (int y = -1; y < ny; y++) {
+						for (int x = -1; x < nx; x++) {
+							int mask = 0;
+							for (int c = 0; c < 8; c++)
+								mask |= inside(x + (c & 1), y + ((c >> 1) & 1), c >> 2) << c;
+							if (mask == 0 || mask == 255)
+								continue;
+							Eigen::Vector3f sum(0, 0, 0);
+							int n = 0;
+							for (int c = 0; c < 8; c++) {
+								for (int a = 0; a < 3; a++) {
+									int d = c | (1 << a);
+									if (d == c || ((mask >> c) & 1) == ((mask >> d) & 1))
+										continue;
+									Eigen::Vector3f mid(c & 1, (c >> 1) & 1, c >> 2);
+									mid[a] = 0.5f;
+									sum += mid;
+									n++;
+								}
+							}
+							cur[cell_id(x, y)] = slab.V.size()/3;
+							slab.V.push_back(x + 0.5f + sum.x()/n);
+							slab.V.push_back(y + 0.5f + sum.y()/n);
+							slab.V.push_back(z + 0.5f + sum.z()/n);
+							slab.cell.push_back(x);
+							slab.cell.push_back(y);
+							slab.cell.push_back(z);
+						}
+					}
+					// <-
+
+					// -> quads of the crossing edges starting at sample layer z. An edge along axis a from
+					// sample p is shared by the cells p - {0, 1}e_u - {0, 1}e_v, counter-clockwise seen
+					// from +a; the edges along x and y also use cell layer z - 1.
+					for (int y = -1; y < ny; y++) {
+						for (int x = -1; x < nx; x++) {
+							const int p[3] = {x, y, z};
+							const bool in = inside(x, y, 0);
+							for (int a = 0; a < 3; a++) {
+								if (inside(x + (a == 0), y + (a == 1), a == 2) == in)
+									continue;
+								const int u = (a + 1) % 3, v = (a + 2) % 3;
+								int64_t ids[4];
+								for (int c = 0; c < 4; c++) {
+									int r[3] = {p[0], p[1], p[2]};
+									r[u] -= (c == 0 || c == 3);
+									r[v] -= (c == 0 || c == 1);
+									ids[c] = (r[2] == z ? cur : prev)[cell_id(r[0], r[1])];
+								}
+								// outwards is from the inside sample to the outside one
+								if (!in)
+									std::swap(ids[1], ids[3]);
+								slab.quads.insert(slab.quads.end(), ids, ids + 4);
+							}
+						}
+					}
+					// <-
+				}
+				for (int y = -1; y < ny; y++)
+					for (int x = -1; x < nx; x++)
+						if (cur[cell_id(x, y)] >= 0)
+							slab.last.emplace_back(cell_id(x, y), cur[cell_id(x, y)]);
+			}
+		}
+
+		// -> vertices and quads of all slabs, in slab order
+		std::vector<size_t> vertex_offset(slabs.size() + 1, 0), quad_offset(slabs.size() + 1, 0);
+		for (size_t k = 0; k < slabs.size(); k++) {
+			vertex_offset[k + 1] = vertex_offset[k] + slabs[k].V.size()/3;
+			quad_offset[k + 1] = quad_offset[k] + slabs[k].quads.size()/4;
+		}
+		const size_t n_verts = vertex_offset.back(), n_quads = quad_offset.back();
+		Eigen::Matrix<float, 3, -1> V(3, n_verts);
+		Eigen::Matrix<int32_t, 3, -1> cell(3, n_verts);
+		std::vector<uint32_t> quads(4*n_quads);
+		#pragma omp parallel for schedule(dynamic, 1)
+		for (int k = 0; k < (int)slabs.size(); k++) {
+			const Slab &slab = slabs[k];
+			std::copy(slab.V.begin(), slab.V.end(), V.data() + 3*vertex_offset[k]);
+			std::copy(slab.cell.begin(), slab.cell.end(), cell.data() + 3*vertex_offset[k]);
+			for (size_t i = 0; i < slab.quads.size(); i++) {
+				int64_t id = slab.quads[i];
+				if (id < 0) {
+					const std::vector<std::pair<int32_t, int32_t>> &last = slabs[k - 1].last;
+					auto it = std::lower_bound(last.begin(), last.end(), std::make_pair((int32_t)(-1 - id), (int32_t)-1));
+					id = (int64_t)vertex_offset[k - 1] + it->second;
+				} else {
+					id += vertex_offset[k];
+				}
+				quads[4*quad_offset[k] + i] = id;
+			}
+		}
+		slabs.clear();
+		// <-
+
+		// -> relaxation, neighbours are the quad edges (in CSR form)
+		std::vector<uint32_t> begin(n_verts + 1, 0), adjacent(8*n_quads);
+		for (size_t i = 0; i < 4*n_quads; i++) {
+			begin[quads[i] + 1]++;
+			begin[quads[i - i % 4 + (i + 1) % 4] + 1]++;
+		}
+		for (size_t i = 0; i < n_verts; i++)
+			begin[i + 1] += begin[i];
+		{
+			std::vector<uint32_t> fill(begin.begin(), begin.end() - 1);
+			for (size_t i = 0; i < 4*n_quads; i++) {
+				uint32_t a = quads[i], b = quads[i - i % 4 + (i + 1) % 4];
+				adjacent[fill[a]++] = b;
+				adjacent[fill[b]++] = a;
+			}
+		}
+		Eigen::Matrix<float, 3, -1> relaxed(3, n_verts);
+		for (int it = 0; it < iterations; it++) {
+			#pragma omp parallel for
+			for (int i = 0; i < (int)n_verts; i++) {
+				Eigen::Vector3f mean(0, 0, 0);
+				for (uint32_t j = begin[i]; j < begin[i + 1]; j++)
+					mean += V.col(adjacent[j]);
+				mean /= (float)(begin[i + 1] - begin[i]);
+				Eigen::Vector3f lo = cell.col(i).cast<float>().array() + 0.5f;
+				relaxed.col(i) = mean.cwiseMax(lo).cwiseMin(lo + Eigen::Vector3f::Ones());
+			}
+			V.swap(relaxed);
+		}
+		// <-
+
+		// two triangles per quad, split along the shorter diagonal
+		mesh.F.resize(3, 2*n_quads);
+		#pragma omp parallel for
+		for (int i = 0; i < (int)n_quads; i++) {
+			const uint32_t *q = &quads[4*(size_t)i];
+			if ((V.col(q[0]) - V.col(q[2])).squaredNorm() <= (V.col(q[1]) - V.col(q[3])).squaredNorm()) {
+				mesh.F.col(2*i) << q[0], q[1], q[2];
+				mesh.F.col(2*i + 1) << q[0], q[2], q[3];
+			} else {
+				mesh.F.col(2*i) << q[0], q[1], q[3];
+				mesh.F.col(2*i + 1) << q[1], q[2], q[3];
+			}
+		}
+		mesh.V = V.array().colwise()/Eigen::Array3f(nx, ny, nz);
+	}
+}
@@ -0,0 +1,637 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sstream>
+
+#include <omp.h>
+
+// Operations on occupancy grids held as bit sets. Every x row is padded to whole 64-bit words (bit
+// x % 64 of word x / 64 of the row), so the neighbours of a word along y and z are the words one row
+// or one slice away and its x neighbours are a shift away. Padding bits are always zero.
+namespace volh {
+	struct RowGrid {
+		int dim[3] = {0, 0, 0};
+		int row_words = 0;
+		std::vector<uint64_t> words;
+
+		void resize(const int d[3]) {
+			for (int i = 0; i < 3; i++)
+				dim[i] = d[i];
+			row_words = (dim[0] + 63)/64;
+			words.assign((size_t)row_words*dim[1]*dim[2], 0);
+		}
+
+		size_t n_rows() const {
+			return (size_t)dim[1]*dim[2];
+		}
+
+		uint64_t *row(int y, int z) {
+			return &words[((size_t)z*dim[1] + y)*row_words];
+		}
+
+		const uint64_t *row(int y, int z) const {
+			return &words[((size_t)z*dim[1] + y)*row_words];
+		}
+
+		// bits of word w of a row that lie within the grid
+		uint64_t valid(int w) const {
+			int n = dim[0] - 64*w;
+			return n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+		}
+	};
+
+	inline void pack(const uint8_t *image, const int dim[3], RowGrid &grid) {
+		grid.resize(dim);
+		#pragma omp parallel for
+		for (int r = 0; r < (int)grid.n_rows(); r++) {
+			const uint8_t *src = image + (size_t)r*dim[0];
+			uint64_t *dst = &grid.words[(size_t)r*grid.row_words];
+			for (int x = 0; x < dim[0]; x++)
+				dst[x >> 6] |= uint64_t(src[x] != 0) << (x & 63);
+		}
+	}
+
+	inline void unpack(const RowGrid &grid, uint8_t *image) {
+		#pragma omp parallel for
+		for (int r = 0; r < (int)grid.n_rows(); r++) {
+			const uint64_t *src = &grid.words[(size_t)r*grid.row_words];
+			uint8_t *dst = image + (size_t)r*grid.dim[0];
+			for (int x = 0; x < grid.dim[0]; x++)
+				dst[x] = (src[x >> 6] >> (x & 63)) & 1;
+		}
+	}
+
+	inline size_t count(const RowGrid &grid) {
+		size_t n = 0;
+		#pragma omp parallel for reduction(+: n)
+		for (size_t i = 0; i < grid.words.size(); i++)
+			n += __builtin_popcountll(grid.words[i]);
+		return n;
+	}
+
+	// word w of a row with every bit moved to the next higher x (bit x holds x - 1) or lower x (bit x holds x + 1)
+	inline uint64_t from_lower(const uint64_t *row, int w) {
+		return row[w] << 1 | (w > 0 ? row[w - 1] >> 63 : 0);
+	}
+
+	inline uint64_t from_higher(const uint64_t *row, int w, int row_words) {
+		return row[w] >> 1 | (w + 1 < row_words ? row[w + 1] << 63 : 0);
+	}
+
+	// the runs of set bits of pass that contain a bit of seed, in six doubling steps per direction
+	inline uint64_t fill_runs(uint64_t seed, uint64_t pass) {
+		uint64_t up = seed & pass, down = up, p_up = pass, p_down = pass;
+		for (int s = 1; s < 64; s <<= 1) {
+			up |= (up << s) & p_up;
+			down |= (down >> s) & p_down;
+			p_up &= p_up << s;
+			p_down &= p_down >> s;
+		}
+		return up | down;
+	}
+
+	// bit x of the result is bit x - k of the row, zero outside it (k may be negative or exceed a word)
+	inline uint64_t shift_row(const uint64_t *row, int w, int k, int row_words) {
+		const int q = k >> 6, b = k & 63;
+		auto word = [&](int i) { return i >= 0 && i < row_words ? row[i] : 0; };
+		return word(w - q) << b | (b ? word(w - q - 1) >> (64 - b) : 0);
+	}
+
+	inline void complement(RowGrid &grid) {
+		#pragma omp parallel for
+		for (size_t i = 0; i < grid.words.size(); i++)
+			grid.words[i] = ~grid.words[i] & grid.valid(i % grid.row_words);
+	}
+
+	// one step of dilation along axis: a voxel is set if it or one of its two neighbours along axis is
+	inline void dilate_axis(const RowGrid &src, RowGrid &dst, int axis) {
+		dst.resize(src.dim);
+		const int ny = src.dim[1], nz = src.dim[2], W = src.row_words;
+		#pragma omp parallel for
+		for (int r = 0; r < (int)src.n_rows(); r++) {
+			const int y = r % ny, z = r / ny;
+			const uint64_t *s = src.row(y, z);
+			uint64_t *d = dst.row(y, z);
+			if (axis == 0) {
+				for (int w = 0; w < W; w++)
+					d[w] = (s[w] | from_lower(s, w) | from_higher(s, w, W)) & src.valid(w);
+				continue;
+			}
+			const uint64_t *lo = axis == 1 ? (y > 0 ? src.row(y - 1, z) : NULL) : (z > 0 ? src.row(y, z - 1) : NULL);
+			const uint64_t *hi = axis == 1 ? (y + 1 < ny ? src.row(y + 1, z) : NULL) : (z + 1 < nz ? src.row(y, z + 1) : NULL);
+			for (int w = 0; w < W; w++)
+				d[w] = s[w] | (lo ? lo[w] : 0) | (hi ? hi[w] : 0);
+		}
+	}
+
+	// Structuring elements, all symmetric about the voxel: the cube of side 2*radius + 1, the cross
+	// (voxels within radius 6-neighbour steps, an octahedron) and the ball of the given radius.
+	enum Shape { CUBE, CROSS, BALL };
+	enum Op { DILATE, ERODE, OPEN, CLOSE };
+
+	struct Element {
+		Shape shape = CUBE;
+		int radius = 1;
+	};
+
+	struct MorphOp {
+		Op op = DILATE;
+		Element element;
+	};
+
+	// whether offset (dx, dy, dz) lies within the element (see VoxelMorphCS.glsl)
+	inline bool in_element(const Element &element, int dx, int dy, int dz) {
+		const int r = element.radius;
+		if (element.shape == CROSS)
+			return std::abs(dx) + std::abs(dy) + std::abs(dz) <= r;
+		if (element.shape == BALL)
+			return dx*dx + dy*dy + dz*dz <= r*r;
+		return std::abs(dx) <= r && std::abs(dy) <= r && std::abs(dz) <= r;
+	}
+
+	// the element as runs along x: for every (dy, dz) offset it covers, the half-width of the run
+	struct Run {
+		int dy, dz, half;
+	};
+
+	inline void element_runs(const Element &element, std::vector<Run> &runs) {
+		const int r = element.radius;
+		runs.clear();
+		for (int dz = -r; dz <= r; dz++) {
+			for (int dy = -r; dy <= r; dy++) {
+				int half = -1;
+				while (half < r && in_element(element, half + 1, dy, dz))
+					half++;
+				if (half >= 0)
+					runs.push_back({dy, dz, half});
+			}
+		}
+	}
+
+	// dilation by any element: every output row ORs the source rows under the runs, each widened along x
+	inline void dilate_runs(const RowGrid &src, RowGrid &dst, const Element &element) {
+		std::vector<Run> runs;
+		element_runs(element, runs);
+		dst.resize(src.dim);
+		const int ny = src.dim[1], nz = src.dim[2], W = src.row_words;
+		#pragma omp parallel for schedule(dynamic, 16)
+		for (int r = 0; r < (int)src.n_rows(); r++) {
+			const int y = r % ny, z = r / ny;
+			uint64_t *d = dst.row(y, z);
+			for (const Run &run : runs) {
+				if (y + run.dy < 0 || y + run.dy >= ny || z + run.dz < 0 || z + run.dz >= nz)
+					continue;
+				const uint64_t *s = src.row(y + run.dy, z + run.dz);
+				for (int w = 0; w < W; w++) {
+					uint64_t bits = s[w];
+					for (int k = 1; k <= run.half; k++)
+						bits |= shift_row(s, w, k, W) | shift_row(s, w, -k, W);
+					d[w] |= bits;
+				}
+			}
+			for (int w = 0; w < W; w++)
+				d[w] &= src.valid(w);
+		}
+	}
+
+	// the cube is separable and costs 3*radius passes of three rows, other elements take one pass over all their runs
+	inline void dilate(RowGrid &grid, const Element &element) {
+		RowGrid tmp;
+		if (element.shape != CUBE) {
+			dilate_runs(grid, tmp, element);
+			std::swap(grid.words, tmp.words);
+			return;
+		}
+		for (int i = 0; i < element.radius; i++) {
+			for (int axis = 0; axis < 3; axis++) {
+				dilate_axis(grid, tmp, axis);
+				std::swap(grid.words, tmp.words);
+			}
+		}
+	}
+
+	// erosion by the same element; outside the grid counts as set, so nothing erodes from the grid border
+	inline void erode(RowGrid &grid, const Element &element) {
+		complement(grid);
+		dilate(grid, element);
+		complement(grid);
+	}
+
+	// removes specks and thin spurs smaller than the element, never adds a voxel
+	inline void open(RowGrid &grid, const Element &element) {
+		erode(grid, element);
+		dilate(grid, element);
+	}
+
+	// closes gaps and holes smaller than the element, never removes a voxel
+	inline void close(RowGrid &grid, const Element &element) {
+		dilate(grid, element);
+		erode(grid, element);
+	}
+
+	inline void apply(RowGrid &grid, const std::vector<MorphOp> &ops) {
+		for (const MorphOp &m : ops) {
+			if (m.op == DILATE)
+				dilate(grid, m.element);
+			else if (m.op == ERODE)
+				erode(grid, m.element);
+			else if (m.op == OPEN)
+				open(grid, m.element);
+			else
+				close(grid, m.element);
+		}
+	}
+
+	// runs a chain of operations on a dense grid in place
+	inline void morph(uint8_t *image, const int dim[3], const std::vector<MorphOp> &ops) {
+		RowGrid grid;
+		pack(image, dim, grid);
+		apply(grid, ops);
+		unpack(grid, image);
+	}
+
+	// parses a chain like "close:cube:2,open:ball:1"; shape and radius default to cube and 1
+	inline bool parse_ops(const std::string &text, std::vector<MorphOp> &ops) {
+		const char *op_names[] = {"dilate", "erode", "open", "close"};
+		const char *shape_names[] = {"cube", "cross", "ball"};
+		std::stringstream chain(text);
+		std::string item;
+		ops.clear();
+		while (std::getline(chain, item, ',')) {
+			std::stringstream fields(item);
+			std::string op, shape = "cube", radius = "1";
+			std::getline(fields, op, ':');
+			std::getline(fields, shape, ':');
+			std::getline(fields, radius, ':');
+			MorphOp m;
+			int i = 0, j = 0;
+			while (i < 4 && op != op_names[i])
+				i++;
+			while (j < 3 && shape != shape_names[j])
+				j++;
+			m.element.radius = std::atoi(radius.c_str());
+			if (i == 4 || j == 3 || m.element.radius < 1)
+				return false;
+			m.op = (Op)i;
+			m.element.shape = (Shape)j;
+			ops.push_back(m);
+		}
+		return !ops.empty();
+	}
+
+	// Voxels connected to the grid border through empty voxels (6-connected). Parallel wavefront BFS:
+	// the frontier is a bit set plus the list of its nonzero words, each step grows it by one voxel along
+	// y and z (and across word ends along x) and new bits are claimed with atomic ORs. A claim always
+	// takes the whole runs of empty voxels along x within the word, so x costs one step per word.
+	inline void flood_exterior(const RowGrid &occupied, RowGrid &exterior) {
+		const int nx = occupied.dim[0], ny = occupied.dim[1], nz = occupied.dim[2], W = occupied.row_words;
+		exterior.resize(occupied.dim);
+		std::vector<uint64_t> front(exterior.words.size(), 0), next(exterior.words.size(), 0);
+		std::vector<size_t> active;
+
+		// empty voxels on the border
+		for (int z = 0; z < nz; z++) {
+			for (int y = 0; y < ny; y++) {
+				const size_t r = (size_t)z*ny + y;
+				const bool face = y == 0 || y == ny - 1 || z == 0 || z == nz - 1;
+				for (int w = 0; w < W; w++) {
+					if (!face && w != 0 && w != W - 1)
+						continue;
+					uint64_t seed = face ? occupied.valid(w) : 0;
+					if (w == 0)
+						seed |= 1;
+					if (w == W - 1)
+						seed |= uint64_t(1) << ((nx - 1) & 63);
+					seed = fill_runs(seed, ~occupied.words[r*W + w] & occupied.valid(w));
+					if (seed) {
+						exterior.words[r*W + w] = seed;
+						front[r*W + w] = seed;
+						active.push_back(r*W + w);
+					}
+				}
+			}
+		}
+
+		std::vector<std::vector<size_t>> found(omp_get_max_threads());
+		while (!active.empty()) {
+			#pragma omp parallel
+			{
+				std::vector<size_t> &mine = found[omp_get_thread_num()];
+				auto visit = [&](size_t t, uint64_t bits) {
+					const uint64_t pass = ~occupied.words[t] & occupied.valid(t % W) & ~__atomic_load_n(&exterior.words[t], __ATOMIC_RELAXED);
+					if (!(bits & pass))
+						return;
+					bits = fill_runs(bits, pass);
+					uint64_t gained = bits & ~__atomic_fetch_or(&exterior.words[t], bits, __ATOMIC_RELAXED);
+					if (gained && !__atomic_fetch_or(&next[t], gained, __ATOMIC_RELAXED))
+						mine.push_back(t);
+				};
+				#pragma omp for schedule(dynamic, 256)
+				for (size_t k = 0; k < active.size(); k++) {
+					const size_t i = active[k];
+					const uint64_t f = front[i];
+					const size_t r = i / W;
+					const int w = i % W, y = r % ny, z = r / ny;
+					if (w > 0)
+						visit(i - 1, f << 63);
+					if (w + 1 < W)
+						visit(i + 1, f >> 63);
+					if (y > 0)
+						visit(i - W, f);
+					if (y + 1 < ny)
+						visit(i + W, f);
+					if (z > 0)
+						visit(i - (size_t)ny*W, f);
+					if (z + 1 < nz)
+						visit(i + (size_t)ny*W, f);
+				}
+			}
+			for (size_t i : active)
+				front[i] = 0;
+			std::swap(front, next);
+			active.clear();
+			for (std::vector<size_t> &f : found) {
+				active.insert(active.end(), f.begin(), f.end());
+				f.clear();
+			}
+		}
+	}
+
+	// Adds voxels until the set is well-composed (Latecki): no four voxels around an edge with only a
+	// diagonal pair set, no 2x2x2 block with only an antipodal pair set or empty. The boundary of such a
+	// set is a 2-manifold, so surface extraction gives no edges or vertices shared by separate sheets.
+	// Returns the number of voxels added.
+	inline size_t make_well_composed(RowGrid &grid) {
+		const int ny = grid.dim[1], nz = grid.dim[2], W = grid.row_words;
+		RowGrid add;
+		size_t total = 0;
+		for (;;) {
+			add.resize(grid.dim);
+			auto set = [&](int y, int z, int w, uint64_t bits) {
+				if (bits)
+					__atomic_fetch_or(&add.row(y, z)[w], bits, __ATOMIC_RELAXED);
+			};
+			#pragma omp parallel for
+			for (int r = 0; r < (int)grid.n_rows(); r++) {
+				const int y = r % ny, z = r / ny;
+				const bool up = y + 1 < ny, back = z + 1 < nz;
+				// rows of the 2x2 block of rows starting at (y, z), absent rows are empty
+				const uint64_t *rows[4] = {grid.row(y, z), up ? grid.row(y + 1, z) : NULL,
+					back ? grid.row(y, z + 1) : NULL, up && back ? grid.row(y + 1, z + 1) : NULL};
+				for (int w = 0; w < W; w++) {
+					// v[c] is corner c = dx | dy << 1 | dz << 2 of the block starting at every x of the word
+					uint64_t v[8];
+					for (int k = 0; k < 4; k++) {
+						v[2*k] = rows[k] ? rows[k][w] : 0;
+						v[2*k + 1] = rows[k] ? from_higher(rows[k], w, W) & grid.valid(w) : 0;
+					}
+					// blocks starting at x whose x + 1 is still in the grid
+					const uint64_t inner = w == W - 1 ? grid.valid(w) >> 1 : ~uint64_t(0);
+					// edges along z (xy faces), along y (xz faces): set the empty corner at x
+					set(y, z, w, inner & ~v[0] & v[1] & v[2] & ~v[3]);
+					set(y + up, z, w, up ? inner & v[0] & ~v[1] & ~v[2] & v[3] : 0);
+					set(y, z, w, back ? inner & ~v[0] & v[1] & v[4] & ~v[5] : 0);
+					set(y, z + back, w, back ? inner & v[0] & ~v[1] & ~v[4] & v[5] : 0);
+					// edges along x (yz faces)
+					if (up && back) {
+						set(y + 1, z, w, v[0] & v[6] & ~v[2] & ~v[4]);
+						set(y, z, w, v[2] & v[4] & ~v[0] & ~v[6]);
+						// 2x2x2 blocks with only an antipodal pair set, or only one empty
+						uint64_t any_other[4], all_other[4];
+						const int pairs[4][2] = {{0, 7}, {1, 6}, {2, 5}, {3, 4}};
+						for (int p = 0; p < 4; p++) {
+							any_other[p] = 0;
+							all_other[p] = ~uint64_t(0);
+							for (int c = 0; c < 8; c++) {
+								if (c == pairs[p][0] || c == pairs[p][1])
+									continue;
+								any_other[p] |= v[c];
+								all_other[p] &= v[c];
+							}
+						}
+						set(y + 1, z, w, inner & v[0] & v[7] & ~any_other[0]);
+						set(y, z, w, inner & v[1] & v[6] & ~any_other[1]);
+						set(y, z, w, inner & v[2] & v[5] & ~any_other[2]);
+						set(y, z, w, inner & v[3] & v[4] & ~any_other[3]);
+						set(y, z, w, inner & ~v[0] & ~v[7] & all_other[0]);
+						set(y + 1, z + 1, w, inner & ~v[1] & ~v[6] & all_other[1]);
+						set(y + 1, z, w, inner & ~v[2] & ~v[5] & all_other[2]);
+						set(y, z + 1, w, inner & ~v[3] & ~v[4] & all_other[3]);
+					}
+				}
+			}
+			size_t n = 0;
+			for (size_t i = 0; i < grid.words.size(); i++) {
+				n += __builtin_popcountll(add.words[i] & ~grid.words[i]);
+				grid.words[i] |= add.words[i];
+			}
+			total += n;
+			if (!n)
+				return total;
+		}
+	}
+
+	struct Component {
+		size_t n_voxels = 0;
+		int min[3], max[3]; // voxel bounding box, inclusive
+	};
+
+	// Connected components of the occupied voxels with 6, 18 or 26 connectivity. The grid is read once,
+	// into runs along x, and the runs are joined by union-find: z slabs in parallel first, then the
+	// slab boundaries. Roots are always the smallest run, so component i (label i + 1) is the i-th to
+	// start in grid order whatever the thread count. Returns the number of components; labels, when
+	// given, gets the label of every voxel (0 where empty).
+	inline size_t label_components(const uint8_t *image, const int dim[3], int connectivity, std::vector<Component> &components,
+			std::vector<uint32_t> *labels = NULL) {
+		const int nx = dim[0], ny = dim[1], nz = dim[2];
+		const size_t n_rows = (size_t)ny*nz;
+		struct Span {
+			int x0, x1;
+		};
+		// the rows before a row (in grid order) whose runs can touch its runs, with the gap along x they may bridge
+		struct Neighbour {
+			int dy, dz, slack;
+		};
+		std::vector<Neighbour> neighbours;
+		if (connectivity == 6)
+			neighbours = {{-1, 0, 0}, {0, -1, 0}};
+		else if (connectivity == 18)
+			neighbours = {{-1, 0, 1}, {0, -1, 1}, {-1, -1, 0}, {1, -1, 0}};
+		else
+			neighbours = {{-1, 0, 1}, {0, -1, 1}, {-1, -1, 1}, {1, -1, 1}};
+
+		std::vector<Span> spans;
+		std::vector<uint32_t> parent;
+		std::vector<size_t> row_begin(n_rows + 1);
+		auto find = [&](uint32_t i) {
+			while (parent[i] != i)
+				i = parent[i] = parent[parent[i]];
+			return i;
+		};
+		auto unite = [&](uint32_t a, uint32_t b) {
+			a = find(a);
+			b = find(b);
+			if (a < b)
+				parent[b] = a;
+			else if (b < a)
+				parent[a] = b;
+		};
+		// joins the touching runs of row (y, z) and row (y + dy, z + dz), both sorted along x
+		auto join_rows = [&](int y, int z, const Neighbour &n) {
+			if (y + n.dy < 0 || y + n.dy >= ny || z + n.dz < 0)
+				return;
+			size_t i = row_begin[(size_t)z*ny + y], i_end = row_begin[(size_t)z*ny + y + 1];
+			size_t j = row_begin[(size_t)(z + n.dz)*ny + y + n.dy], j_end = row_begin[(size_t)(z + n.dz)*ny + y + n.dy + 1];
+			while (i < i_end && j < j_end) {
+				if (spans[i].x0 < spans[j].x1 + n.slack && spans[j].x0 < spans[i].x1 + n.slack)
+					unite(i, j);
+				if (spans[i].x1 < spans[j].x1)
+					i++;
+				else
+					j++;
+			}
+		};
+
+		const int n_slabs = std::max(std::min(omp_get_max_threads(), nz), 1);
+		std::vector<size_t> slab_begin(n_slabs + 1, 0);
+		#pragma omp parallel num_threads(n_slabs)
+		{
+			const int s = omp_get_thread_num();
+			const int z0 = (int)((int64_t)nz*s/n_slabs), z1 = (int)((int64_t)nz*(s + 1)/n_slabs);
+			std::vector<Span> local;
+			for (size_t r = (size_t)z0*ny; r < (size_t)z1*ny; r++) {
+				row_begin[r] = local.size();
+				const uint8_t *row = image + r*nx;
+				for (int x = 0; x < nx;) {
+					// empty space is skipped eight voxels at a time
+					uint64_t chunk = 1;
+					if (x + 8 <= nx)
+						memcpy(&chunk, row + x, 8);
+					if (!chunk || !row[x]) {
+						x += chunk ? 1 : 8;
+						continue;
+					}
+					int x0 = x;
+					while (x < nx && row[x])
+						x++;
+					local.push_back({x0, x});
+				}
+			}
+			slab_begin[s + 1] = local.size();
+			#pragma omp barrier
+			#pragma omp single
+			{
+				for (int k = 0; k < n_slabs; k++)
+					slab_begin[k + 1] += slab_begin[k];
+				spans.resize(slab_begin[n_slabs]);
+				parent.resize(spans.size());
+				row_begin[n_rows] = spans.size();
+			}
+			const size_t offset = slab_begin[s];
+			std::copy(local.begin(), local.end(), spans.begin() + offset);
+			for (size_t i = offset; i < slab_begin[s + 1]; i++)
+				parent[i] = i;
+			for (size_t r = (size_t)z0*ny; r < (size_t)z1*ny; r++)
+				row_begin[r] += offset;
+			#pragma omp barrier
+			for (int z = z0; z < z1; z++)
+				for (int y = 0; y < ny; y++)
+					for (const Neighbour &n : neighbours)
+						if (z + n.dz >= z0)
+							join_rows(y, z, n);
+		}
+		for (int s = 1; s < n_slabs; s++) {
+			const int z = (int)((int64_t)nz*s/n_slabs);
+			for (int y = 0; y < ny; y++)
+				for (const Neighbour &n : neighbours)
+					if (n.dz < 0)
+						join_rows(y, z, n);
+		}
+
+		// parents precede their runs, so one pass in order resolves every run to its component
+		components.clear();
+		for (size_t i = 0; i < spans.size(); i++) {
+			if (parent[i] == i) {
+				parent[i] = components.size();
+				components.emplace_back();
+			} else {
+				parent[i] = parent[parent[i]];
+			}
+		}
+		for (size_t r = 0; r < n_rows; r++) {
+			const int y = r % ny, z = r / ny;
+			for (size_t i = row_begin[r]; i < row_begin[r + 1]; i++) {
+				Component &c = components[parent[i]];
+				const int lo[3] = {spans[i].x0, y, z}, hi[3] = {spans[i].x1 - 1, y, z};
+				for (int k = 0; k < 3; k++) {
+					c.min[k] = c.n_voxels ? std::min(c.min[k], lo[k]) : lo[k];
+					c.max[k] = c.n_voxels ? std::max(c.max[k], hi[k]) : hi[k];
+				}
+				c.n_voxels += spans[i].x1 - spans[i].x0;
+			}
+		}
+
+		if (labels) {
+			labels->assign((size_t)nx*n_rows, 0);
+			#pragma omp parallel for
+			for (int r = 0; r < (int)n_rows; r++)
+				for (size_t i = row_begin[r]; i < row_begin[r + 1]; i++)
+					std::fill(labels->begin() + (size_t)r*nx + spans[i].x0, labels->begin() + (size_t)r*nx + spans[i].x1, parent[i] + 1);
+		}
+		return components.size();
+	}
+
+	// the component count and the largest components, biggest first
+	inline void print_components(const std::vector<Component> &components, int connectivity, size_t max_lines = 10) {
+		std::vector<uint32_t> order(components.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return components[a].n_voxels > components[b].n_voxels; });
+		printf("components: %zu (%d-connected)\n", components.size(), connectivity);
+		for (size_t k = 0; k < std::min(max_lines, order.size()); k++) {
+			const Component &c = components[order[k]];
+			printf("  label %u: %zu voxels, box [%d %d %d] - [%d %d %d]\n", order[k] + 1, c.n_voxels,
+				c.min[0], c.min[1], c.min[2], c.max[0], c.max[1], c.max[2]);
+		}
+	}
+
+	struct RepairStats {
+		size_t input = 0;
+		size_t closed = 0;
+		size_t solid = 0;
+		size_t well_composed = 0;
+	};
+
+	inline void print_repair_stats(const RepairStats &stats) {
+		printf("repair: %zu voxels, %zu after close, %zu solid, %zu added for a manifold boundary\n",
+			stats.input, stats.closed, stats.solid + stats.well_composed, stats.well_composed);
+	}
+
+	// Watertight solid from a surface voxelization of a possibly open mesh: gaps up to about 2*radius
+	// voxels wide are closed, everything the exterior flood fill cannot reach is solid, and the solid is
+	// made well-composed so that surfh::surface_nets gives a closed 2-manifold.
+	inline void repair(uint8_t *image, const int dim[3], int radius, RepairStats *stats = NULL) {
+		RowGrid grid, exterior;
+		pack(image, dim, grid);
+		if (stats)
+			stats->input = count(grid);
+		if (radius > 0)
+			close(grid, {CUBE, radius});
+		if (stats)
+			stats->closed = count(grid);
+		flood_exterior(grid, exterior);
+		complement(exterior);
+		if (stats)
+			stats->solid = count(exterior);
+		size_t added = make_well_composed(exterior);
+		if (stats)
+			stats->well_composed = added;
+		unpack(exterior, image);
+	}
+}
@@ -0,0 +1,805 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <fstream>
+#include <iostream>
+#include <cassert>
+#include <mutex>
+#include <condition_variable>
+
+#include "OpenGLHelper.h"
+#include "MeshHelper.h"
+#include "CPUVoxelHelper.h"
+#include "VolumeHelper.h"
+#include "ProfileHelper.h"
+
+namespace voxh {
+	struct VoxelizationVAO {
+		GLuint program;
+		GLuint id_vao, id_vbo_position, id_image_occupany, id_image_color;
+		GLuint id_image_normal[3];
+		GLuint scatter_program, id_ssbo_cells; // sub-voxel merging
+		GLuint id_vbo_label, id_indirect, id_image_label; // scenes
+		GLuint morph_program, id_image_scratch; // morphology
+		GLuint pack_program, id_ssbo_bits; // bit-packed readback
+	};
+
+	// Element buffer of a face list. Faces are drawn in one call with 32-bit indices or, for a
+	// compressed upload, as meshlets of 16-bit indices (see meshh::build_meshlets) in one multi-draw.
+	struct FaceBuffer {
+		GLuint id = 0;
+		GLenum type = GL_UNSIGNED_INT;
+		int n_faces = 0;
+		std::vector<GLsizei> count;
+		std::vector<const void*> offset;
+		std::vector<GLint> base_vertex;
+
+		// the buffer is bound to the current VAO. Without meshlets the faces are uploaded as they are.
+		void upload(const uint32_t *faces, int nFaces, const std::vector<uint16_t> *indices = NULL,
+				const std::vector<meshh::Meshlet> *meshlets = NULL) {
+			n_faces = nFaces;
+			count.clear();
+			offset.clear();
+			base_vertex.clear();
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+			if (meshlets) {
+				type = GL_UNSIGNED_SHORT;
+				for (const meshh::Meshlet &m : *meshlets) {
+					count.push_back(3*m.n_faces);
+					offset.push_back((const void*)(3*(size_t)m.first_face*sizeof(GLushort)));
+					base_vertex.push_back(m.base_vertex);
+				}
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices->size()*sizeof(GLushort), indices->data(), GL_STATIC_DRAW);
+			} else {
+				type = GL_UNSIGNED_INT;
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, 3*(size_t)nFaces*sizeof(GLuint), faces, GL_STATIC_DRAW);
+			}
+		}
+
+		// 16-bit meshlets when compress is set and the vertex order allows them
+		void upload(const uint32_t *faces, int nFaces, bool compress) {
+			std::vector<uint16_t> indices;
+			std::vector<meshh::Meshlet> meshlets;
+			if (compress && meshh::build_meshlets(faces, nFaces, indices, meshlets))
+				upload(faces, nFaces, &indices, &meshlets);
+			else
+				upload(faces, nFaces);
+		}
+
+		// with the VAO bound
+		void draw() const {
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
+			if (type == GL_UNSIGNED_SHORT)
+				glMultiDrawElementsBaseVertex(GL_TRIANGLES, count.data(), type, offset.data(), count.size(), base_vertex.data());
+			else
+				glDrawElements(GL_TRIANGLES, 3*n_faces, type, 0);
+		}
+	};
+
+	// sub-voxel merging only pays off (and keeps its host scratch grid small) for low-res previews
+	const int MAX_MERGE_DIM = 256;
+
+	// Geometry shader voxelizer. The program and buffers are created once by init(), meshes and
+	// grids can then be swapped with upload_mesh() and init_grid() without recompiling anything.
+	// With exact, vertices are snapped to the cpuvoxh fixed-point lattice and tested in integers
+	// (needs GL_ARB_gpu_shader_int64), so the grid matches cpuvoxh::voxelize(..., true) bit for bit.
+	// With merge, triangles within a single voxel are taken out of the draw up to MAX_MERGE_DIM (see
+	// cpuvoxh::split_subvoxel) and their voxels are written by VoxelScatterCS.glsl instead; the grid
+	// is unchanged. Merging is skipped while normals are accumulated.
+	// With compress, positions are uploaded as 16-bit normalized integers (within 1/131070 of the unit
+	// cube of the float ones) and faces as 16-bit meshlets, which halves upload size and VRAM. Exact
+	// positions use 16 bits as long as the fixed-point lattice fits (dims below 256), losslessly.
+	// Scenes (upload_scene()) are drawn with one indirect command per object, whose base instance
+	// picks the object label from an instanced attribute; the label grid keeps the largest label of
+	// every voxel, like cpuvoxh::voxelize_labels. Scenes neither merge nor use 16-bit faces.
+	class Voxelizer {
+	public:
+		void init(cpuvoxh::Thickness thickness = cpuvoxh::THIN, bool exact = false, bool merge = false, bool compress = false) {
+			std::string dir = std::string(HOMEDIR) + "/src/glsl/";
+			std::string exact_define = exact ? "#define EXACT 1\n" : "";
+			std::string defines = (thickness == cpuvoxh::FAT ? "#define THICKNESS FAT\n" : "#define THICKNESS THIN\n") + exact_define;
+			GLuint vs = 0, gs = 0, fs = 0;
+			oglh::load_shader(vs, dir + "/VoxelizationVS.glsl", GL_VERTEX_SHADER, exact_define);
+			oglh::load_shader(gs, dir + "/VoxelizationGS.glsl", GL_GEOMETRY_SHADER, defines);
+			oglh::load_shader(fs, dir + "/VoxelizationFS.glsl", GL_FRAGMENT_SHADER);
+			GLuint shaders[3] = {vs, gs, fs};
+			oglh::create_program(vao.program, shaders, 3);
+			glUseProgram(vao.program);
+			glGenVertexArrays(1, &vao.id_vao);
+			glBindVertexArray(vao.id_vao);
+			glGenBuffers(1, &vao.id_vbo_position);
+			glGenBuffers(1, &faces.id);
+			glGenBuffers(1, &vao.id_vbo_label);
+			glGenBuffers(1, &vao.id_indirect);
+			vao.id_image_occupany = 0;
+			vao.id_image_label = 0;
+			vao.morph_program = 0;
+			vao.id_image_scratch = 0;
+			vao.pack_program = 0;
+			vao.id_ssbo_bits = 0;
+			for (int i = 0; i < 3; i++)
+				vao.id_image_normal[i] = 0;
+			exact_positions = exact;
+			compress_upload = compress;
+
+			merge_subvoxel = merge;
+			merge_thickness = thickness;
+			merged_resolution[0] = 0;
+			if (merge) {
+				GLuint cs = 0;
+				oglh::load_shader(cs, dir + "/VoxelScatterCS.glsl", GL_COMPUTE_SHADER);
+				oglh::create_program(vao.scatter_program, &cs, 1);
+				glGenBuffers(1, &spanning_faces.id);
+				glGenBuffers(1, &vao.id_ssbo_cells);
+			}
+		}
+
+		void upload_mesh(const meshh::Mesh &input, bool scene = false) {
+			profh::GpuScope scope("upload");
+			glBindVertexArray(vao.id_vao);
+			n_objects = 0;
+			scene_upload = scene;
+
+			// -> elements (buffer object)
+			// a vertex order too scattered for 16-bit meshlets is renumbered in first-use order first,
+			// which does not change the grid
+			const meshh::Mesh *mesh = &input;
+			meshh::Mesh reordered;
+			std::vector<uint16_t> indices;
+			std::vector<meshh::Meshlet> meshlets;
+			bool meshlet_faces = compress_upload && !scene && meshh::build_meshlets(input.F.data(), input.F.cols(), indices, meshlets);
+			if (compress_upload && !scene && !meshlet_faces) {
+				profh::HostScope scope("reorder_vertices");
+				reordered = input;
+				meshh::reorder_vertices(reordered);
+				mesh = &reordered;
+				meshlet_faces = meshh::build_meshlets(mesh->F.data(), mesh->F.cols(), indices, meshlets);
+			}
+			if (meshlet_faces)
+				faces.upload(mesh->F.data(), mesh->F.cols(), &indices, &meshlets);
+			else
+				faces.upload(mesh->F.data(), mesh->F.cols());
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			// <-
+
+			// -> position (buffer object), fixed-point positions depend on the grid and are uploaded by voxelize()
+			if (merge_subvoxel && !scene) {
+				merge_mesh = *mesh;
+				merged_resolution[0] = 0;
+			}
+			if (exact_positions) {
+				positions = mesh->V;
+				quantized_resolution[0] = 0;
+			} else if (compress_upload) {
+				std::vector<uint16_t> unorm(mesh->V.size());
+				for (size_t j = 0; j < unorm.size(); j++)
+					unorm[j] = (uint16_t)std::lround(std::min(std::max(mesh->V.data()[j], 0.0f), 1.0f)*65535.0f);
+				// the sub-voxel split must see the positions the GPU sees
+				if (merge_subvoxel && !scene)
+					for (size_t j = 0; j < unorm.size(); j++)
+						merge_mesh.V.data()[j] = unorm[j]/65535.0f;
+				glBindBuffer(GL_ARRAY_BUFFER, vao.id_vbo_position);
+				glBufferData(GL_ARRAY_BUFFER, unorm.size()*sizeof(GLushort), unorm.data(), GL_STATIC_DRAW);
+				position_type = GL_UNSIGNED_SHORT;
+			} else {
+				glBindBuffer(GL_ARRAY_BUFFER, vao.id_vbo_position);
+				glBufferData(GL_ARRAY_BUFFER, mesh->V.size()*sizeof(GLfloat), mesh->V.data(), GL_STATIC_DRAW);
+				position_type = GL_FLOAT;
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			// <-
+
+			mesh_min = mesh->V.rowwise().minCoeff();
+			mesh_max = mesh->V.rowwise().maxCoeff();
+		}
+
+		// the faces of every object are contiguous in scene.mesh, so each one is a single draw
+		void upload_scene(const meshh::Scene &scene) {
+			upload_mesh(scene.mesh, true);
+			n_objects = scene.n_objects();
+
+			struct DrawElementsIndirectCommand {
+				GLuint count, instance_count, first_index;
+				GLint base_vertex;
+				GLuint base_instance;
+			};
+			std::vector<DrawElementsIndirectCommand> commands(n_objects);
+			std::vector<GLuint> labels(n_objects);
+			for (int i = 0; i < n_objects; i++) {
+				commands[i].count = 3*(scene.object_faces[i + 1] - scene.object_faces[i]);
+				commands[i].instance_count = 1;
+				commands[i].first_index = 3*scene.object_faces[i];
+				commands[i].base_vertex = 0;
+				commands[i].base_instance = i;
+				labels[i] = i + 1;
+			}
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, vao.id_indirect);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size()*sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			glBindBuffer(GL_ARRAY_BUFFER, vao.id_vbo_label);
+			glBufferData(GL_ARRAY_BUFFER, labels.size()*sizeof(GLuint), labels.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		// (re)allocates the grid textures when the resolution changes and zeroes them. Fresh textures
+		// are cleared entirely, reused ones only within the region the previous voxelize() touched.
+		void init_grid(const int resolution[3], bool normals, bool labels = false) {
+			bool same = vao.id_image_occupany && resolution[0] == voxelResolution[0] &&
+				resolution[1] == voxelResolution[1] && resolution[2] == voxelResolution[2];
+			if (!same) {
+				term_grid();
+				for (int i = 0; i < 3; i++)
+					voxelResolution[i] = resolution[i];
+			}
+			accumulate_normals = normals;
+			write_labels = labels;
+
+			profh::GpuScope scope("clear");
+			GLuint zero = 0;
+
+			// -> Occuancy Grid
+			glActiveTexture(GL_TEXTURE0);
+			if (!same) {
+				glGenTextures(1, &vao.id_image_occupany);
+				glBindTexture(GL_TEXTURE_3D, vao.id_image_occupany);
+				glTexStorage3D(GL_TEXTURE_3D, 1, GL_R8UI, voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+				glClearTexImage(vao.id_image_occupany, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &zero);
+			} else {
+				clear_dirty(vao.id_image_occupany, GL_UNSIGNED_BYTE);
+			}
+			glBindImageTexture(0, vao.id_image_occupany, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R8UI);
+			// <-
+
+			// -> Normal Grid (fixed-point, one R32I texture per component for image atomics)
+			for (int i = 0; i < 3 && vao.id_image_normal[i]; i++)
+				clear_dirty(vao.id_image_normal[i], GL_INT);
+			if (accumulate_normals) {
+				for (int i = 0; i < 3; i++) {
+					if (!vao.id_image_normal[i]) {
+						glGenTextures(1, &vao.id_image_normal[i]);
+						glBindTexture(GL_TEXTURE_3D, vao.id_image_normal[i]);
+						glTexStorage3D(GL_TEXTURE_3D, 1, GL_R32I, voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+						glClearTexImage(vao.id_image_normal[i], 0, GL_RED_INTEGER, GL_INT, &zero);
+					}
+					glBindImageTexture(2 + i, vao.id_image_normal[i], 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32I);
+				}
+			}
+			// <-
+
+			// -> Label Grid (R32UI for imageAtomicMax, narrowed to uint16 by read_labels())
+			if (vao.id_image_label)
+				clear_dirty(vao.id_image_label, GL_UNSIGNED_INT);
+			if (write_labels) {
+				if (!vao.id_image_label) {
+					glGenTextures(1, &vao.id_image_label);
+					glBindTexture(GL_TEXTURE_3D, vao.id_image_label);
+					glTexStorage3D(GL_TEXTURE_3D, 1, GL_R32UI, voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+					glClearTexImage(vao.id_image_label, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+				}
+				glBindImageTexture(5, vao.id_image_label, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+			}
+			// <-
+
+			for (int i = 0; i < 3; i++) {
+				dirty_min[i] = 0;
+				dirty_max[i] = 0;
+			}
+		}
+
+		void voxelize() {
+			profh::GpuScope scope("voxelize");
+			glUseProgram(vao.program);
+			glBindVertexArray(vao.id_vao);
+
+			glBindBuffer(GL_ARRAY_BUFFER, vao.id_vbo_position);
+			if (exact_positions) {
+				if (!std::equal(voxelResolution, voxelResolution + 3, quantized_resolution)) {
+					profh::HostScope scope("quantize");
+					assert(*std::max_element(voxelResolution, voxelResolution + 3) <= cpuvoxh::EXACT_MAX_DIM);
+					Eigen::Matrix<int32_t, 3, -1> Q;
+					cpuvoxh::quantize_positions(positions, voxelResolution, Q);
+					if (compress_upload && Q.minCoeff() >= 0 && Q.maxCoeff() <= 0xffff) {
+						Eigen::Matrix<uint16_t, 3, -1> Q16 = Q.cast<uint16_t>();
+						glBufferData(GL_ARRAY_BUFFER, Q16.size()*sizeof(GLushort), Q16.data(), GL_STATIC_DRAW);
+						position_type = GL_UNSIGNED_SHORT;
+					} else {
+						glBufferData(GL_ARRAY_BUFFER, Q.size()*sizeof(GLint), Q.data(), GL_STATIC_DRAW);
+						position_type = GL_INT;
+					}
+					std::copy(voxelResolution, voxelResolution + 3, quantized_resolution);
+				}
+				glVertexAttribIPointer(0, 3, position_type, 0, 0);
+			} else {
+				glVertexAttribPointer(0, 3, position_type, position_type != GL_FLOAT, 0, 0);
+			}
+			glEnableVertexAttribArray(0);
+
+			bool labels = write_labels && n_objects;
+			if (labels) {
+				glBindBuffer(GL_ARRAY_BUFFER, vao.id_vbo_label);
+				glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, 0, 0);
+				glVertexAttribDivisor(1, 1);
+				glEnableVertexAttribArray(1);
+			}
+
+			bool merge = merge_subvoxel && !scene_upload && !accumulate_normals && *std::max_element(voxelResolution, voxelResolution + 3) <= MAX_MERGE_DIM;
+			if (merge && !std::equal(voxelResolution, voxelResolution + 3, merged_resolution))
+				split_subvoxel();
+
+			glUniform3iv(glGetUniformLocation(vao.program, "voxelResolution"), 1, voxelResolution);
+			glUniform1i(glGetUniformLocation(vao.program, "accumulateNormals"), accumulate_normals);
+			glUniform1i(glGetUniformLocation(vao.program, "writeLabels"), labels);
+
+			if (labels) {
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces.id);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, vao.id_indirect);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, n_objects, 0);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			} else {
+				(merge ? spanning_faces : faces).draw();
+			}
+			if (merge && n_cells) {
+				glUseProgram(vao.scatter_program);
+				glUniform3iv(glGetUniformLocation(vao.scatter_program, "voxelResolution"), 1, voxelResolution);
+				glUniform1ui(glGetUniformLocation(vao.scatter_program, "nCells"), n_cells);
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vao.id_ssbo_cells);
+				glDispatchCompute(std::min((n_cells + 255)/256, 65535), 1, 1);
+			}
+			mark_dirty();
+
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			glDisableVertexAttribArray(0);
+			glDisableVertexAttribArray(1);
+		}
+
+		// splits the mesh for the current resolution, the spanning triangles go to their own element
+		// buffer and the cells of the sub-voxel ones to the scatter buffer
+		void split_subvoxel() {
+			profh::HostScope scope("split_subvoxel");
+			Eigen::Matrix<uint32_t, -1, -1> spanning;
+			std::vector<uint32_t> cells;
+			cpuvoxh::split_subvoxel(merge_mesh, voxelResolution, merge_thickness, exact_positions, spanning, cells);
+			spanning_faces.upload(spanning.data(), spanning.cols(), compress_upload);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, vao.id_ssbo_cells);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, cells.size()*sizeof(GLuint), cells.data(), GL_STATIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			n_cells = cells.size();
+			std::copy(voxelResolution, voxelResolution + 3, merged_resolution);
+		}
+
+		void read_occupancy(std::vector<uint8_t> &image) {
+			image.resize((size_t)voxelResolution[0]*voxelResolution[1]*voxelResolution[2]);
+			read_occupancy(image.data());
+		}
+
+		// downloads the dense grid straight into caller memory of dimx*dimy*dimz bytes
+		void read_occupancy(uint8_t *image) {
+			profh::GpuScope scope("readback");
+			// image stores of voxelize() must be visible to the texture download
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_3D, vao.id_image_occupany);
+			glGetTexImage(GL_TEXTURE_3D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, image);
+		}
+
+		// Packs the grid on the GPU (VoxelPackCS.glsl) and downloads the words of a gridh::BitGrid
+		// ((dimx*dimy*dimz + 63)/64 uint64) straight into caller memory, 1/8 of the dense transfer.
+		void read_bits(uint64_t *words) {
+			profh::GpuScope scope("readback_bits");
+			const size_t n_words = ((size_t)voxelResolution[0]*voxelResolution[1]*voxelResolution[2] + 63)/64;
+			if (!vao.pack_program) {
+				GLuint cs = 0;
+				oglh::load_shader(cs, std::string(HOMEDIR) + "/src/glsl/VoxelPackCS.glsl", GL_COMPUTE_SHADER);
+				oglh::create_program(vao.pack_program, &cs, 1);
+				glGenBuffers(1, &vao.id_ssbo_bits);
+			}
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, vao.id_ssbo_bits);
+			if (bits_capacity < n_words) {
+				glBufferData(GL_SHADER_STORAGE_BUFFER, n_words*sizeof(uint64_t), NULL, GL_STREAM_READ);
+				bits_capacity = n_words;
+			}
+			glUseProgram(vao.pack_program);
+			glUniform3iv(glGetUniformLocation(vao.pack_program, "voxelResolution"), 1, voxelResolution);
+			glUniform1ui(glGetUniformLocation(vao.pack_program, "nWords"), 2*n_words);
+			glBindImageTexture(0, vao.id_image_occupany, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R8UI);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, vao.id_ssbo_bits);
+			// image stores of voxelize() must be visible to the pack
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			glDispatchCompute(std::min<size_t>((2*n_words + 255)/256, 65535), 1, 1);
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, n_words*sizeof(uint64_t), words);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+
+		// Morphology on the grid texture (VoxelMorphCS.glsl), chained after voxelize() with no readback:
+		// same result as volh::morph. Passes ping-pong between the grid and a scratch texture.
+		void morph(const std::vector<volh::MorphOp> &ops) {
+			profh::GpuScope scope("morph");
+			if (!vao.morph_program) {
+				GLuint cs = 0;
+				oglh::load_shader(cs, std::string(HOMEDIR) + "/src/glsl/VoxelMorphCS.glsl", GL_COMPUTE_SHADER);
+				oglh::create_program(vao.morph_program, &cs, 1);
+			}
+			if (!vao.id_image_scratch) {
+				glGenTextures(1, &vao.id_image_scratch);
+				glBindTexture(GL_TEXTURE_3D, vao.id_image_scratch);
+				glTexStorage3D(GL_TEXTURE_3D, 1, GL_R8UI, voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+			}
+			glUseProgram(vao.morph_program);
+			glUniform3iv(glGetUniformLocation(vao.morph_program, "voxelResolution"), 1, voxelResolution);
+			// image stores of voxelize() must be visible to the first pass
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+			GLuint images[2] = {vao.id_image_occupany, vao.id_image_scratch};
+			int current = 0;
+			auto pass = [&](const volh::Element &element, const int extent[3], bool erode) {
+				glUniform3iv(glGetUniformLocation(vao.morph_program, "extent"), 1, extent);
+				glUniform1i(glGetUniformLocation(vao.morph_program, "shape"), element.shape);
+				glUniform1i(glGetUniformLocation(vao.morph_program, "radius"), element.radius);
+				glUniform1i(glGetUniformLocation(vao.morph_program, "erode"), erode);
+				glBindImageTexture(0, images[current], 0, GL_TRUE, 0, GL_READ_ONLY, GL_R8UI);
+				glBindImageTexture(7, images[1 - current], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R8UI);
+				glDispatchCompute((voxelResolution[0] + 7)/8, (voxelResolution[1] + 7)/8, (voxelResolution[2] + 7)/8);
+				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+				current = 1 - current;
+			};
+			auto step = [&](const volh::Element &element, bool erode) {
+				const int r = element.radius;
+				if (element.shape != volh::CUBE) {
+					const int extent[3] = {r, r, r};
+					pass(element, extent, erode);
+					return;
+				}
+				for (int axis = 0; axis < 3; axis++) {
+					const int extent[3] = {axis == 0 ? r : 0, axis == 1 ? r : 0, axis == 2 ? r : 0};
+					pass(element, extent, erode);
+				}
+			};
+			for (const volh::MorphOp &m : ops) {
+				bool erode_first = m.op == volh::ERODE || m.op == volh::OPEN;
+				step(m.element, erode_first);
+				if (m.op == volh::OPEN || m.op == volh::CLOSE)
+					step(m.element, !erode_first);
+			}
+			if (current == 1) {
+				glCopyImageSubData(vao.id_image_scratch, GL_TEXTURE_3D, 0, 0, 0, 0, vao.id_image_occupany, GL_TEXTURE_3D, 0, 0, 0, 0,
+					voxelResolution[0], voxelResolution[1], voxelResolution[2]);
+			}
+			glBindImageTexture(0, vao.id_image_occupany, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R8UI);
+			// dilation spreads past the voxelized region
+			for (int i = 0; i < 3; i++) {
+				dirty_min[i] = 0;
+				dirty_max[i] = voxelResolution[i];
+			}
+		}
+
+		// replaces the grid by one processed on the host (e.g. volh::repair), so that the viewer shows it
+		void write_occupancy(const std::vector<uint8_t> &image) {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glBindTexture(GL_TEXTURE_3D, vao.id_image_occupany);
+			glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, voxelResolution[0], voxelResolution[1], voxelResolution[2],
+				GL_RED_INTEGER, GL_UNSIGNED_BYTE, image.data());
+			for (int i = 0; i < 3; i++) {
+				dirty_min[i] = 0;
+				dirty_max[i] = voxelResolution[i];
+			}
+		}
+
+		// object label of every voxel (0 where empty), grid order
+		void read_labels(std::vector<uint16_t> &labels) {
+			profh::GpuScope scope("readback_labels");
+			std::vector<uint32_t> wide((size_t)voxelResolution[0]*voxelResolution[1]*voxelResolution[2]);
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+			glBindTexture(GL_TEXTURE_3D, vao.id_image_label);
+			glGetTexImage(GL_TEXTURE_3D, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, wide.data());
+			labels.assign(wide.begin(), wide.end());
+		}
+
+		// reads back the accumulated fixed-point normals and normalizes them for every occupied voxel (same order as compact())
+		void read_normals(const std::vector<uint8_t> &image, std::vector<float> &normal) {
+			profh::GpuScope scope("readback_normals");
+			const float fixed_point_scale = 65536.0f; // NORMAL_FIXED_POINT_SCALE in VoxelizationGS.glsl
+			std::vector<int32_t> accum[3];
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+			for (int i = 0; i < 3; i++) {
+				accum[i].resize(image.size());
+				glBindTexture(GL_TEXTURE_3D, vao.id_image_normal[i]);
+				glGetTexImage(GL_TEXTURE_3D, 0, GL_RED_INTEGER, GL_INT, accum[i].data());
+			}
+
+			normal.clear();
+			for (size_t index = 0; index < image.size(); index++) {
+				if (image[index]) {
+					Eigen::Vector3f n(accum[0][index], accum[1][index], accum[2][index]);
+					n /= fixed_point_scale;
+					if (n.norm() > 0)
+						n.normalize();
+					normal.push_back(n.x());
+					normal.push_back(n.y());
+					normal.push_back(n.z());
+				}
+			}
+		}
+
+		// grows the dirty region by the voxel bounding box of the current mesh (one voxel of slack for rounding)
+		void mark_dirty() {
+			for (int i = 0; i < 3; i++) {
+				int lo = std::max((int)std::floor(mesh_min[i]*voxelResolution[i]) - 1, 0);
+				int hi = std::min((int)std::ceil(mesh_max[i]*voxelResolution[i]) + 1, voxelResolution[i]);
+				bool empty = dirty_max[i] <= dirty_min[i];
+				dirty_min[i] = empty ? lo : std::min(dirty_min[i], lo);
+				dirty_max[i] = empty ? hi : std::max(dirty_max[i], hi);
+			}
+		}
+
+		void clear_dirty(GLuint texture, GLenum type) {
+			if (dirty_max[0] <= dirty_min[0] || dirty_max[1] <= dirty_min[1] || dirty_max[2] <= dirty_min[2])
+				return;
+			GLuint zero = 0;
+			glClearTexSubImage(texture, 0, dirty_min[0], dirty_min[1], dirty_min[2],
+				dirty_max[0] - dirty_min[0], dirty_max[1] - dirty_min[1], dirty_max[2] - dirty_min[2],
+				GL_RED_INTEGER, type, &zero);
+		}
+
+		void term_grid() {
+			if (vao.id_image_occupany)
+				glDeleteTextures(1, &vao.id_image_occupany);
+			vao.id_image_occupany = 0;
+			for (int i = 0; i < 3; i++) {
+				if (vao.id_image_normal[i])
+					glDeleteTextures(1, &vao.id_image_normal[i]);
+				vao.id_image_normal[i] = 0;
+			}
+			if (vao.id_image_label)
+				glDeleteTextures(1, &vao.id_image_label);
+			vao.id_image_label = 0;
+			if (vao.id_image_scratch)
+				glDeleteTextures(1, &vao.id_image_scratch);
+			vao.id_image_scratch = 0;
+		}
+
+		void term() {
+			term_grid();
+			glDeleteBuffers(1, &vao.id_vbo_position);
+			glDeleteBuffers(1, &faces.id);
+			glDeleteBuffers(1, &vao.id_vbo_label);
+			glDeleteBuffers(1, &vao.id_indirect);
+			glDeleteVertexArrays(1, &vao.id_vao);
+			glDeleteProgram(vao.program);
+			if (merge_subvoxel) {
+				glDeleteBuffers(1, &spanning_faces.id);
+				glDeleteBuffers(1, &vao.id_ssbo_cells);
+				glDeleteProgram(vao.scatter_program);
+			}
+			if (vao.morph_program)
+				glDeleteProgram(vao.morph_program);
+			if (vao.pack_program) {
+				glDeleteProgram(vao.pack_program);
+				glDeleteBuffers(1, &vao.id_ssbo_bits);
+			}
+			bits_capacity = 0;
+		}
+
+		VoxelizationVAO vao;
+		int voxelResolution[3] = {0, 0, 0};
+		FaceBuffer faces;
+		bool accumulate_normals = false;
+		Eigen::Vector3f mesh_min, mesh_max;
+		bool exact_positions = false;
+		Eigen::Matrix<float, -1, -1> positions; // unit cube positions kept for re-snapping in exact mode
+		int quantized_resolution[3] = {0, 0, 0};
+		bool compress_upload = false;
+		GLenum position_type = GL_FLOAT; // of the uploaded positions
+		bool scene_upload = false, write_labels = false;
+		int n_objects = 0; // of the uploaded scene, one indirect draw each
+		size_t bits_capacity = 0; // words of id_ssbo_bits
+
+		bool merge_subvoxel = false;
+		cpuvoxh::Thickness merge_thickness = cpuvoxh::THIN;
+		meshh::Mesh merge_mesh; // kept to re-split when the resolution changes
+		int merged_resolution[3] = {0, 0, 0};
+		FaceBuffer spanning_faces;
+		int n_cells = 0;
+
+		int dirty_min[3] = {0, 0, 0}, dirty_max[3] = {0, 0, 0}; // voxels written since the last clear, [min, max)
+	};
+
+	// Asynchronous occupancy readback. Each slot is a persistently mapped GL_PIXEL_PACK_BUFFER that
+	// the texture is downloaded into, guarded by a fence. begin() only queues the copy, so the GL thread
+	// can go on with the next mesh; wait() blocks until the copy landed and returns the mapped grid,
+	// which stays valid (from any thread) until release(). begin() blocks while all slots are in use.
+	class ReadbackRing {
+	public:
+		void init(int n) {
+			slots.resize(n);
+		}
+
+		int begin(const Voxelizer &voxelizer) {
+			profh::GpuScope scope("readback_async");
+			int id = acquire();
+			Slot &slot = slots[id];
+			const int *res = voxelizer.voxelResolution;
+			size_t n_bytes = (size_t)res[0]*res[1]*res[2];
+			if (slot.capacity < n_bytes) {
+				if (slot.pbo)
+					glDeleteBuffers(1, &slot.pbo);
+				GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glGenBuffers(1, &slot.pbo);
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+				glBufferStorage(GL_PIXEL_PACK_BUFFER, n_bytes, NULL, flags);
+				slot.data = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, n_bytes, flags);
+				slot.capacity = n_bytes;
+			}
+
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+			glBindTexture(GL_TEXTURE_3D, voxelizer.vao.id_image_occupany);
+			glGetTexImage(GL_TEXTURE_3D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, 0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+			return id;
+		}
+
+		// must be called on the GL thread
+		const uint8_t *wait(int id) {
+			Slot &slot = slots[id];
+			if (slot.fence) {
+				while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+				glDeleteSync(slot.fence);
+				slot.fence = 0;
+			}
+			return slot.data;
+		}
+
+		// may be called from any thread once the mapped data is no longer needed
+		void release(int id) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slots[id].busy = false;
+			}
+			cv.notify_all();
+		}
+
+		void term() {
+			for (auto &slot : slots) {
+				if (slot.fence)
+					glDeleteSync(slot.fence);
+				if (slot.pbo) {
+					glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+					glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+					glDeleteBuffers(1, &slot.pbo);
+				}
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			slots.clear();
+		}
+
+	private:
+		struct Slot {
+			GLuint pbo = 0;
+			GLsync fence = 0;
+			size_t capacity = 0;
+			const uint8_t *data = NULL;
+			bool busy = false;
+		};
+
+		int acquire() {
+			std::unique_lock<std::mutex> lock(mutex);
+			int id = -1;
+			cv.wait(lock, [&] {
+				for (int i = 0; i < (int)slots.size(); i++) {
+					if (!slots[i].busy) {
+						id = i;
+						return true;
+					}
+				}
+				return false;
+			});
+			slots[id].busy = true;
+			return id;
+		}
+
+		std::vector<Slot> slots;
+		std::mutex mutex;
+		std::condition_variable cv;
+	};
+
+	// turns the dense occupancy grid into a list of normalized voxel positions, returns the voxel count
+	inline int compact(const uint8_t *image, const int voxelResolution[3], std::vector<float> &position) {
+		profh::HostScope scope("compaction");
+		int n_size = 0;
+		position.clear();
+		for (int i = 0; i < voxelResolution[2]; i++) {
+			for (int j = 0; j < voxelResolution[1]; j++) {
+				for (int k = 0; k < voxelResolution[0]; k++) {
+					size_t index = ((size_t)i*voxelResolution[1] + j)*voxelResolution[0] + k;
+					if (image[index]) {
+						position.push_back((float)k/voxelResolution[0]);
+						position.push_back((float)j/voxelResolution[1]);
+						position.push_back((float)i/voxelResolution[2]);
+						n_size++;
+					}
+				}
+			}
+		}
+		return n_size;
+	}
+
+	inline int compact(const std::vector<uint8_t> &image, const int voxelResolution[3], std::vector<float> &position) {
+		return compact(image.data(), voxelResolution, position);
+	}
+
+	// lists the faces of occupied voxels whose neighbour is empty or outside the grid, as (x, y, z, face)
+	// with faces 0..5 for -x, +x, -y, +y, -z, +z, in grid order. Interior faces are dropped, so a solid
+	// grid costs O(surface) instead of 36 vertices per voxel (see VoxelFaceVS.glsl). Returns the count.
+	inline int exposed_faces(const uint8_t *image, const int voxelResolution[3], std::vector<uint16_t> &faces) {
+		profh::HostScope scope("exposed_faces");
+		const int nx = voxelResolution[0], ny = voxelResolution[1], nz = voxelResolution[2];
+		assert(std::max(nx, std::max(ny, nz)) <= 0xffff);
+		const size_t step[3] = {1, (size_t)nx, (size_t)nx*ny};
+		std::vector<std::vector<uint16_t>> slices(nz);
+		#pragma omp parallel for schedule(dynamic, 1)
+		for (int z = 0; z < nz; z++) {
+			std::vector<uint16_t> &out = slices[z];
+			for (int y = 0; y < ny; y++) {
+				for (int x = 0; x < nx; x++) {
+					size_t index = z*step[2] + y*step[1] + x;
+					if (!image[index])
+						continue;
+					const int p[3] = {x, y, z};
+					for (int face = 0; face < 6; face++) {
+						int axis = face >> 1;
+						bool exposed = (face & 1) ? p[axis] + 1 == voxelResolution[axis] || !image[index + step[axis]]
+							: p[axis] == 0 || !image[index - step[axis]];
+						if (exposed) {
+							out.push_back(x);
+							out.push_back(y);
+							out.push_back(z);
+							out.push_back(face);
+						}
+					}
+				}
+			}
+		}
+		faces.clear();
+		for (const std::vector<uint16_t> &slice : slices)
+			faces.insert(faces.end(), slice.begin(), slice.end());
+		return faces.size()/4;
+	}
+
+
+	inline void save_file(const std::string &filename, int dim, const std::vector<float> &position) {
+		profh::HostScope scope("save_file");
+		int n_size = position.size()/3;
+		std::ofstream outFile(filename, std::ios::out);
+		assert(outFile.is_open());
+		outFile << dim << std::endl;
+		outFile << n_size << std::endl;
+		for (int i = 0; i < n_size; i++)
+			outFile << position[3*i + 0] << " " << position[3*i + 1] << " " << position[3*i + 2] << std::endl;
+		outFile.close();
+	}
+
+	inline void save_normals_file(const std::string &filename, int dim, const std::vector<float> &position, const std::vector<float> &normal) {
+		profh::HostScope scope("save_normals_file");
+
+		int n_size = position.size()/3;
+		std::ofstream outFile(filename, std::ios::out);
+		assert(outFile.is_open());
+		outFile << dim << std::endl;
+		outFile << n_size << std::endl;
+		for (int i = 0; i < n_size; i++)
+			outFile << position[3*i + 0] << " " << position[3*i + 1] << " " << position[3*i + 2] << " "
+				<< normal[3*i + 0] << " " << normal[3*i + 1] << " " << normal[3*i + 2] << std::endl;
+		outFile.close();
+	}
+}
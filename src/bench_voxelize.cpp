@@ -0,0 +1,603 @@
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+
+#include <omp.h>
+#include <Eigen/Dense>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "OpenGLHelper.h"
+#include "MeshHelper.h"
+#include "VoxelHelper.h"
+#include "CPUVoxelHelper.h"
+#include "SIMDVoxelHelper.h"
+#include "GridHelper.h"
+#include "VolumeHelper.h"
+#include "SurfaceHelper.h"
+#include "ProfileHelper.h"
+
+// Throughput benchmark for the voxelization pipeline. Every (mesh, dim, mode) is run -reps times
+// through load, upload, voxelize, readback, compaction and save and the per-stage medians are
+// written as JSON. Meshes can carry a "@N" suffix to subdivide them N times (synthetic dense meshes).
+//
+// With -golden <dir> it doubles as the regression check: every grid is compared voxel-for-voxel with
+// <dir>/<mesh>_<mode>_<dim>.voxb (the label grid of a .scene input also with .voxl) and, given -baseline <previous.json>, the voxelize median must not be
+// slower than the baseline by more than -tolerance. Any failure makes the process exit with 1.
+//
+// A dim is a cube edge or XxYxZ for a box grid, e.g. -dims 64,128x32x48 (x fastest, like main's -dim).
+//
+// -repair, -components and -surface nets run the CPU post-processing of main on every grid (stage
+// "post"). The golden check then covers the repaired grid (<...>_repair<r>.voxb), the component labels
+// (<...>_c<n>.voxl) and the repair, component and surface counts (<...>.counts, one "name value" per
+// line); surface nets must also give a closed, consistently oriented mesh.
+//
+// Example: ./bench_voxelize -dims 32,64,128 -meshes bunny.obj,bunny.obj@2 -reps 5 -json bench.json
+//          ./bench_voxelize -backend cpu -dims 32,64 -modes thin,fat -golden ../resources/golden
+//          ./bench_voxelize -backend cpu -simd avx2 -meshes ../resources/bunny.obj -dims 128,256,512 (CPU kernel microbenchmark)
+//          ./bench_voxelize -backend cpu -threads 16 -meshes ../resources/sofa.ply@3 -dims 512,1024 (CPU thread scaling)
+//          ./bench_voxelize -backend cpu -dims 64 -repair 2 -components 26 -surface nets -golden ../resources/golden
+
+
+struct BenchArgs {
+	std::vector<std::string> meshes;
+	std::vector<std::string> dims = {"32", "64", "128", "256", "512", "1024"};
+	int reps = 5;
+	std::string json_file = "bench_voxelize.json";
+	std::string tmp_file = "bench_voxelize.vox";
+	std::string profile_file;
+	std::string backend = "gl";
+	bool exact = false;
+	bool clean = false;
+	bool merge = false;
+	bool compress = false;
+	std::string simd; // CPU kernel, the best supported one if empty
+	int threads = 0; // CPU backend threads, all OpenMP threads if 0
+	std::vector<cpuvoxh::Thickness> modes = {cpuvoxh::THIN};
+	int repair = -1; // volh::repair radius, off if < 0
+	int components = 0; // volh::label_components connectivity, off if 0
+	bool surface_nets = false;
+	std::string golden_dir;
+	bool write_golden = false;
+	std::string baseline_file;
+	double tolerance = 0.25;
+} bench_args;
+
+static const char *stage_names[] = {"load", "upload", "voxelize", "readback", "post", "compaction", "save"};
+static const int n_stages = 7;
+
+struct BenchResult {
+	std::string mesh;
+	std::string dim; // as given in -dims
+	int resolution[3];
+	cpuvoxh::Thickness mode;
+	std::string golden; // "", "match", "mismatch", "missing" or "written"
+	int64_t n_mismatches = 0;
+	double baseline_ms = 0;
+	bool regressed = false;
+	int n_faces, n_verts, n_voxels;
+	// post-processing, see -repair, -components and -surface
+	volh::RepairStats repair;
+	size_t n_components = 0;
+	int n_surface_verts = 0, n_surface_faces = 0;
+	int64_t n_open_edges = 0; // directed surface edges without exactly one opposite twin
+	double stage_ms[n_stages];
+	double total_ms;
+};
+
+static std::vector<std::string> split(const std::string &s, char delim) {
+	std::vector<std::string> tokens;
+	std::stringstream ss(s);
+	std::string token;
+	while (std::getline(ss, token, delim))
+		if (!token.empty())
+			tokens.push_back(token);
+	return tokens;
+}
+
+static double median(std::vector<double> v) {
+	std::sort(v.begin(), v.end());
+	int n = v.size();
+	return n % 2 ? v[n/2] : 0.5*(v[n/2 - 1] + v[n/2]);
+}
+
+// "64" is a 64^3 grid, "128x32x48" one of 128 x 32 x 48 voxels; false unless every edge is positive
+static bool parse_dim(const std::string &dim, int resolution[3]) {
+	std::vector<std::string> edges = split(dim, 'x');
+	if (edges.size() != 1 && edges.size() != 3)
+		return false;
+	for (int i = 0; i < 3; i++) {
+		const std::string &edge = edges[edges.size() == 1 ? 0 : i];
+		if (edge.find_first_not_of("0123456789") != std::string::npos || edge.size() > 9)
+			return false;
+		resolution[i] = std::stoi(edge);
+		if (resolution[i] <= 0)
+			return false;
+	}
+	return true;
+}
+
+// cubes stay JSON numbers (as in older baselines), box grids become strings
+static std::string dim_json(const std::string &dim) {
+	return dim.find('x') == std::string::npos ? dim : "\"" + dim + "\"";
+}
+
+static const char *mode_name(cpuvoxh::Thickness mode) {
+	return mode == cpuvoxh::FAT ? "fat" : "thin";
+}
+
+// integer-snapped runs, cleaned meshes, sub-voxel merging and compressed uploads (gl only), explicitly
+// chosen CPU kernels and thread counts are reported (and compared against baselines) as their own
+// backend, e.g. cpu_avx2, cpu_16t, gl_clean, gl_merge, gl_compress or gl_exact
+static std::string backend_name() {
+	std::string name = bench_args.backend;
+	if (bench_args.clean)
+		name += "_clean";
+	if (bench_args.merge && bench_args.backend != "cpu")
+		name += "_merge";
+	if (bench_args.compress && bench_args.backend != "cpu")
+		name += "_compress";
+	if (!bench_args.simd.empty())
+		name += "_" + bench_args.simd;
+	if (bench_args.threads > 0)
+		name += "_" + std::to_string(bench_args.threads) + "t";
+	return bench_args.exact ? name + "_exact" : name;
+}
+
+// bunny.obj@2 in mode thin at dim 64 -> bunny_obj_2_thin_64.voxb (bunny_obj_2_thin_exact_64.voxb with -exact,
+// bunny_obj_2_thin_128x32x48.voxb at dim 128x32x48), label grids of scenes go to .voxl next to it; the
+// post-processing outputs add a suffix, e.g. bunny_obj_thin_64_repair2_c26.voxl
+static std::string golden_file(const std::string &spec, cpuvoxh::Thickness mode, const std::string &dim, const char *extension = ".voxb",
+		const std::string &suffix = "") {
+	std::string name = spec.substr(spec.find_last_of("/\\") + 1);
+	std::replace(name.begin(), name.end(), '.', '_');
+	std::replace(name.begin(), name.end(), '@', '_');
+	return bench_args.golden_dir + "/" + name + "_" + mode_name(mode) + (bench_args.exact ? "_exact_" : "_") + dim + suffix + extension;
+}
+
+static std::string repair_suffix() {
+	return bench_args.repair >= 0 ? "_repair" + std::to_string(bench_args.repair) : "";
+}
+
+static std::string components_suffix() {
+	return repair_suffix() + "_c" + std::to_string(bench_args.components);
+}
+
+// the post-processing counts as "name value" lines, empty without post-processing
+static std::string post_counts(const BenchResult &result) {
+	std::ostringstream out;
+	if (bench_args.repair >= 0) {
+		out << "repair_input " << result.repair.input << "\n" << "repair_closed " << result.repair.closed << "\n";
+		out << "repair_solid " << result.repair.solid << "\n" << "repair_well_composed " << result.repair.well_composed << "\n";
+	}
+	if (bench_args.components)
+		out << "components " << result.n_components << "\n";
+	if (bench_args.surface_nets)
+		out << "surface_verts " << result.n_surface_verts << "\n" << "surface_faces " << result.n_surface_faces << "\n";
+	return out.str();
+}
+
+static std::string post_suffix() {
+	return (bench_args.components ? components_suffix() : repair_suffix()) + (bench_args.surface_nets ? "_nets" : "");
+}
+
+// mismatching voxels of a label grid, -1 if the golden has another size; false if it cannot be read
+static bool compare_labels(const std::string &filename, const int dim[3], const std::vector<uint16_t> &labels, int64_t &n_mismatches) {
+	int golden_dim[3];
+	std::vector<uint16_t> golden;
+	if (!gridh::load_labels(filename, golden_dim, golden))
+		return false;
+	n_mismatches = -1;
+	if (std::equal(dim, dim + 3, golden_dim)) {
+		n_mismatches = 0;
+		for (size_t i = 0; i < labels.size(); i++)
+			n_mismatches += labels[i] != golden[i];
+	}
+	return true;
+}
+
+// mismatching lines of the post-processing counts; false if the golden cannot be read
+static bool compare_counts(const std::string &filename, const std::string &counts, int64_t &n_mismatches) {
+	std::ifstream in(filename);
+	if (!in.is_open()) {
+		fprintf(stderr, "Error: Could not read %s.\n", filename.c_str());
+		return false;
+	}
+	std::vector<std::string> lines = split(counts, '\n'), golden;
+	std::string line;
+	while (std::getline(in, line))
+		if (!line.empty())
+			golden.push_back(line);
+	n_mismatches = std::abs((int64_t)lines.size() - (int64_t)golden.size());
+	for (size_t i = 0; i < std::min(lines.size(), golden.size()); i++)
+		n_mismatches += lines[i] != golden[i];
+	return true;
+}
+
+// labels (scenes only), component labels and post-processing counts are compared as well, their
+// mismatches add to the occupancy ones
+static void check_golden(const std::vector<uint8_t> &image, const std::vector<uint16_t> *labels,
+		const std::vector<uint16_t> *components, BenchResult &result) {
+	gridh::BitGrid grid, golden;
+	const int *dim = result.resolution;
+	gridh::pack(image, dim, grid);
+	std::string filename = golden_file(result.mesh, result.mode, result.dim, ".voxb", repair_suffix());
+	std::string labels_file = golden_file(result.mesh, result.mode, result.dim, ".voxl");
+	std::string components_file = golden_file(result.mesh, result.mode, result.dim, ".voxl", components_suffix());
+	std::string counts_file = golden_file(result.mesh, result.mode, result.dim, ".counts", post_suffix());
+	std::string counts = post_counts(result);
+	// more components than the 16-bit label file holds
+	bool too_many = bench_args.components && !components;
+	if (bench_args.write_golden) {
+		bool saved = gridh::save_binary(filename, grid) && (!labels || gridh::save_labels(labels_file, dim, *labels)) &&
+			!too_many && (!components || gridh::save_labels(components_file, dim, *components));
+		if (saved && !counts.empty()) {
+			std::ofstream out(counts_file);
+			out << counts;
+			saved = out.good();
+		}
+		result.golden = saved ? "written" : "missing";
+		return;
+	}
+	int64_t n_labels = 0, n_components = 0, n_counts = 0;
+	if (!gridh::load_binary(filename, golden) || (labels && !compare_labels(labels_file, dim, *labels, n_labels)) ||
+			(components && !compare_labels(components_file, dim, *components, n_components)) ||
+			(!counts.empty() && !compare_counts(counts_file, counts, n_counts))) {
+		result.golden = "missing";
+		return;
+	}
+	result.n_mismatches = gridh::count_mismatches(grid, golden);
+	for (int64_t n : {n_labels, n_components, n_counts, too_many ? (int64_t)-1 : 0})
+		result.n_mismatches = result.n_mismatches < 0 || n < 0 ? -1 : result.n_mismatches + n;
+	result.golden = result.n_mismatches == 0 ? "match" : "mismatch";
+}
+
+// voxelize median of the same (mesh, dim, mode, backend) in a JSON written by a previous run, 0 if absent
+static double find_baseline(const BenchResult &result) {
+	std::ifstream in(bench_args.baseline_file);
+	std::string line;
+	std::string key = "{\"mesh\": \"" + result.mesh + "\", \"dim\": " + dim_json(result.dim) +
+		", \"mode\": \"" + mode_name(result.mode) + "\", \"backend\": \"" + backend_name() + "\"";
+	while (std::getline(in, line)) {
+		if (line.find(key) == std::string::npos)
+			continue;
+		size_t pos = line.find("\"voxelize\": ");
+		if (pos != std::string::npos)
+			return std::stod(line.substr(pos + 12));
+	}
+	return 0;
+}
+
+// directed edges of a triangle mesh that are not matched by exactly one reversed edge, 0 for a closed,
+// consistently oriented 2-manifold
+static int64_t count_open_edges(const meshh::Mesh &mesh) {
+	std::unordered_map<uint64_t, int> edges;
+	for (int f = 0; f < mesh.F.cols(); f++)
+		for (int i = 0; i < 3; i++)
+			edges[(uint64_t)mesh.F(i, f) << 32 | mesh.F((i + 1) % 3, f)]++;
+	int64_t n_open = 0;
+	for (auto &e : edges) {
+		auto twin = edges.find(e.first << 32 | e.first >> 32);
+		n_open += e.second != 1 || twin == edges.end() || twin->second != 1;
+	}
+	return n_open;
+}
+
+static bool is_scene(const std::string &spec) {
+	return spec.size() > 6 && spec.compare(spec.size() - 6, 6, ".scene") == 0;
+}
+
+// .scene files keep their objects for the label grid and are fit into the unit cube as a whole, like in main
+static void load_bench_mesh(const std::string &spec, meshh::Scene &scene) {
+	meshh::Mesh &mesh = scene.mesh;
+	if (is_scene(spec)) {
+		if (!meshh::load_scene(spec, scene))
+			std::exit(1);
+		meshh::normalize_mesh(mesh);
+		return;
+	}
+	std::string filename = spec;
+	int n_levels = 0;
+	size_t at = spec.rfind('@');
+	if (at != std::string::npos) {
+		filename = spec.substr(0, at);
+		n_levels = std::stoi(spec.substr(at + 1));
+	}
+	meshh::load_mesh(filename, mesh);
+	meshh::subdivide_mesh(mesh, n_levels);
+	if (bench_args.clean) {
+		meshh::CleanStats stats;
+		meshh::normalize_clean_mesh(mesh, stats);
+	} else {
+		meshh::normalize_mesh(mesh);
+	}
+}
+
+static BenchResult run_bench(voxh::Voxelizer &voxelizer, const std::string &spec, const std::string &dim, cpuvoxh::Thickness mode) {
+	typedef std::chrono::steady_clock clock;
+	auto ms = [](clock::time_point t0, clock::time_point t1) {
+		return std::chrono::duration<double, std::milli>(t1 - t0).count();
+	};
+
+	BenchResult result;
+	result.mesh = spec;
+	result.dim = dim;
+	result.mode = mode;
+	bool cpu = bench_args.backend == "cpu";
+	std::vector<double> samples[n_stages], totals;
+	int *resolution = result.resolution;
+	parse_dim(dim, resolution);
+
+	// host buffers are reused across repetitions, readback resizes them on first use
+	const bool scene = is_scene(spec);
+	std::vector<uint8_t> image;
+	std::vector<uint16_t> labels, component_labels;
+	std::vector<float> position;
+	for (int rep = 0; rep < bench_args.reps; rep++) {
+		meshh::Scene input;
+		meshh::Mesh &mesh = input.mesh;
+
+		clock::time_point t[n_stages + 1];
+
+		t[0] = clock::now();
+		{
+			profh::HostScope scope("load_mesh");
+			load_bench_mesh(spec, input);
+		}
+		t[1] = clock::now();
+		if (!cpu) {
+			if (scene)
+				voxelizer.upload_scene(input);
+			else
+				voxelizer.upload_mesh(mesh);
+			voxelizer.init_grid(resolution, false, scene);
+			glFinish();
+		}
+		t[2] = clock::now();
+		if (cpu && scene) {
+			// scenes voxelize into the label grid, the occupancy is where it is set
+			profh::HostScope scope("voxelize_cpu");
+			cpuvoxh::voxelize_labels(input, resolution, mode, labels, bench_args.exact);
+			image.resize(labels.size());
+			#pragma omp parallel for
+			for (int64_t i = 0; i < (int64_t)labels.size(); i++)
+				image[i] = labels[i] != 0;
+		} else if (cpu) {
+			profh::HostScope scope("voxelize_cpu");
+			cpuvoxh::voxelize(mesh, resolution, mode, image, bench_args.exact);
+		} else {
+			voxelizer.voxelize();
+			glFinish();
+		}
+		t[3] = clock::now();
+		if (!cpu) {
+			voxelizer.read_occupancy(image);
+			if (scene)
+				voxelizer.read_labels(labels);
+		}
+		t[4] = clock::now();
+		bool components_fit = true;
+		{
+			profh::HostScope scope("post");
+			if (bench_args.repair >= 0)
+				volh::repair(image.data(), resolution, bench_args.repair, &result.repair);
+			if (bench_args.components) {
+				std::vector<volh::Component> components;
+				std::vector<uint32_t> component_ids;
+				result.n_components = volh::label_components(image.data(), resolution, bench_args.components, components, &component_ids);
+				components_fit = result.n_components <= 0xffff;
+				component_labels.assign(component_ids.begin(), component_ids.end());
+			}
+			if (bench_args.surface_nets) {
+				meshh::Mesh surface;
+				surfh::surface_nets(image.data(), resolution, surface);
+				result.n_surface_verts = surface.V.cols();
+				result.n_surface_faces = surface.F.cols();
+				result.n_open_edges = count_open_edges(surface);
+			}
+		}
+		t[5] = clock::now();
+		result.n_voxels = voxh::compact(image, resolution, position);
+		t[6] = clock::now();
+		voxh::save_file(bench_args.tmp_file, *std::max_element(resolution, resolution + 3), position);
+		t[7] = clock::now();
+
+		for (int i = 0; i < n_stages; i++)
+			samples[i].push_back(ms(t[i], t[i + 1]));
+		totals.push_back(ms(t[0], t[n_stages]));
+		result.n_faces = mesh.F.cols();
+		result.n_verts = mesh.V.cols();
+		if (rep == 0 && !bench_args.golden_dir.empty())
+			check_golden(image, scene ? &labels : NULL, bench_args.components && components_fit ? &component_labels : NULL, result);
+	}
+	std::remove(bench_args.tmp_file.c_str());
+
+	for (int i = 0; i < n_stages; i++)
+		result.stage_ms[i] = median(samples[i]);
+	result.total_ms = median(totals);
+
+	if (!bench_args.baseline_file.empty()) {
+		result.baseline_ms = find_baseline(result);
+		result.regressed = result.baseline_ms > 0 && result.stage_ms[2] > result.baseline_ms*(1.0 + bench_args.tolerance);
+	}
+	return result;
+}
+
+static void write_json(const std::string &filename, const std::vector<BenchResult> &results) {
+	std::ofstream out(filename, std::ios::out);
+	assert(out.is_open());
+	out << "{\n";
+	if (bench_args.backend == "gl") {
+		out << "  \"vendor\": \"" << glGetString(GL_VENDOR) << "\",\n";
+		out << "  \"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n";
+	}
+	if (bench_args.backend == "cpu")
+		out << "  \"threads\": " << omp_get_max_threads() << ",\n";
+	out << "  \"reps\": " << bench_args.reps << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t r = 0; r < results.size(); r++) {
+		const BenchResult &res = results[r];
+		// throughput is measured against the voxelize stage only
+		double voxelize_s = res.stage_ms[2]*1e-3;
+		out << "    {\"mesh\": \"" << res.mesh << "\", \"dim\": " << dim_json(res.dim);
+		out << ", \"mode\": \"" << mode_name(res.mode) << "\", \"backend\": \"" << backend_name() << "\"";
+		out << ", \"n_faces\": " << res.n_faces << ", \"n_verts\": " << res.n_verts << ", \"n_voxels\": " << res.n_voxels;
+		out << ", \"median_ms\": {";
+		for (int i = 0; i < n_stages; i++)
+			out << "\"" << stage_names[i] << "\": " << res.stage_ms[i] << ", ";
+		out << "\"total\": " << res.total_ms << "}";
+		out << ", \"triangles_per_s\": " << (voxelize_s > 0 ? res.n_faces/voxelize_s : 0);
+		out << ", \"voxels_per_s\": " << (voxelize_s > 0 ? res.n_voxels/voxelize_s : 0);
+		if (bench_args.repair >= 0)
+			out << ", \"repair\": {\"input\": " << res.repair.input << ", \"closed\": " << res.repair.closed << ", \"solid\": " << res.repair.solid
+				<< ", \"well_composed\": " << res.repair.well_composed << "}";
+		if (bench_args.components)
+			out << ", \"n_components\": " << res.n_components;
+		if (bench_args.surface_nets)
+			out << ", \"surface\": {\"n_verts\": " << res.n_surface_verts << ", \"n_faces\": " << res.n_surface_faces << ", \"n_open_edges\": " << res.n_open_edges << "}";
+		if (!res.golden.empty())
+			out << ", \"golden\": \"" << res.golden << "\", \"n_mismatches\": " << res.n_mismatches;
+		if (!bench_args.baseline_file.empty())
+			out << ", \"baseline_voxelize_ms\": " << res.baseline_ms << ", \"regressed\": " << (res.regressed ? "true" : "false");
+		out << "}" << (r + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n";
+	out << "}\n";
+	out.close();
+}
+
+static void parse_args(int argc, char** argv) {
+	std::string res = std::string(HOMEDIR) + "/resources/";
+	bench_args.meshes = {res + "icosahedron.obj", res + "bunny.obj", res + "sofa.ply", res + "bunny.obj@2", res + "sofa.ply@2"};
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string key = argv[i];
+		if (key == "-dims") {
+			bench_args.dims = split(argv[i + 1], ',');
+			int resolution[3];
+			for (auto &d : bench_args.dims)
+				if (!parse_dim(d, resolution)) {
+					printf("Error: invalid dim %s, expected N or XxYxZ.\n", d.c_str());
+					std::exit(1);
+				}
+		} else if (key == "-meshes") {
+			bench_args.meshes = split(argv[i + 1], ',');
+		} else if (key == "-reps") {
+			bench_args.reps = std::max(1, std::stoi(argv[i + 1]));
+		} else if (key == "-json") {
+			bench_args.json_file = argv[i + 1];
+		} else if (key == "-tmp") {
+			bench_args.tmp_file = argv[i + 1];
+		} else if (key == "-profile") {
+			bench_args.profile_file = argv[i + 1];
+		} else if (key == "-backend") {
+			bench_args.backend = argv[i + 1];
+		} else if (key == "-exact") {
+			bench_args.exact = std::string(argv[i + 1]) == "on";
+		} else if (key == "-clean") {
+			bench_args.clean = std::string(argv[i + 1]) == "on";
+		} else if (key == "-merge") {
+			bench_args.merge = std::string(argv[i + 1]) == "on";
+		} else if (key == "-compress") {
+			bench_args.compress = std::string(argv[i + 1]) == "on";
+		} else if (key == "-simd") {
+			simdvoxh::Level level;
+			if (!simdvoxh::parse_level(argv[i + 1], level) || level > simdvoxh::detect()) {
+				printf("Error: SIMD kernel %s is not supported on this CPU (best: %s).\n", argv[i + 1], simdvoxh::level_name(simdvoxh::detect()));
+				std::exit(1);
+			}
+			simdvoxh::level() = level;
+			bench_args.simd = argv[i + 1];
+		} else if (key == "-threads") {
+			bench_args.threads = std::max(1, std::stoi(argv[i + 1]));
+			omp_set_num_threads(bench_args.threads);
+		} else if (key == "-modes") {
+			bench_args.modes.clear();
+			for (auto &m : split(argv[i + 1], ','))
+				bench_args.modes.push_back(m == "fat" ? cpuvoxh::FAT : cpuvoxh::THIN);
+		} else if (key == "-repair") {
+			bench_args.repair = std::stoi(argv[i + 1]);
+		} else if (key == "-components") {
+			bench_args.components = std::stoi(argv[i + 1]);
+			if (bench_args.components != 6 && bench_args.components != 18 && bench_args.components != 26) {
+				printf("Error: -components takes 6, 18 or 26.\n");
+				std::exit(1);
+			}
+		} else if (key == "-surface") {
+			bench_args.surface_nets = std::string(argv[i + 1]) == "nets";
+		} else if (key == "-golden") {
+			bench_args.golden_dir = argv[i + 1];
+		} else if (key == "-write_golden") {
+			bench_args.golden_dir = argv[i + 1];
+			bench_args.write_golden = true;
+		} else if (key == "-baseline") {
+			bench_args.baseline_file = argv[i + 1];
+		} else if (key == "-tolerance") {
+			bench_args.tolerance = std::stod(argv[i + 1]);
+		} else {
+			printf("Example Usage: ./bench_voxelize -dims 32,64,128 -meshes bunny.obj,bunny.obj@2 -reps 5 -json bench.json [-tmp ./bench.vox] [-profile ./trace.json]\n");
+			printf("                                [-backend gl|cpu] [-exact on|off] [-clean on|off] [-merge on|off] [-compress on|off] [-simd scalar|avx2|avx512] [-threads n] [-modes thin,fat] [-golden dir | -write_golden dir] [-baseline old.json -tolerance 0.25]\n");
+			printf("                                [-repair 2] [-components 6|18|26] [-surface nets]\n");
+
+			std::exit(1);
+		}
+	}
+	// the integer-snapped voxelizer asserts on larger grids
+	for (auto &d : bench_args.dims) {
+		int resolution[3];
+		parse_dim(d, resolution);
+		if (bench_args.exact && *std::max_element(resolution, resolution + 3) > cpuvoxh::EXACT_MAX_DIM) {
+			printf("Error: -exact on supports dims up to %d, got %s.\n", cpuvoxh::EXACT_MAX_DIM, d.c_str());
+			std::exit(1);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	parse_args(argc, argv);
+	if (!bench_args.profile_file.empty())
+		profh::get().enable();
+	// the CPU backend runs without any GL context (headless CI)
+	bool gl = bench_args.backend != "cpu";
+	GLFWwindow *window;
+	if (gl)
+		oglh::init_gl("bench_voxelize", 64, 64, &window, false);
+
+	int n_failures = 0;
+	std::vector<BenchResult> results;
+	for (auto mode : bench_args.modes) {
+		voxh::Voxelizer voxelizer;
+		if (gl)
+			voxelizer.init(mode, bench_args.exact, bench_args.merge, bench_args.compress);
+
+		for (auto &spec : bench_args.meshes) {
+			for (auto &dim : bench_args.dims) {
+				BenchResult res = run_bench(voxelizer, spec, dim, mode);
+				printf("%s dim: %s mode: %s n_voxels: %d voxelize: %.3f ms total: %.3f ms", spec.c_str(), dim.c_str(), mode_name(mode), res.n_voxels, res.stage_ms[2], res.total_ms);
+				if (bench_args.surface_nets)
+					printf(" open edges: %ld", (long)res.n_open_edges);
+				if (!res.golden.empty())
+					printf(" golden: %s (%ld mismatches)", res.golden.c_str(), (long)res.n_mismatches);
+				if (res.regressed)
+					printf(" REGRESSED (baseline %.3f ms)", res.baseline_ms);
+				printf("\n");
+				n_failures += res.golden == "mismatch" || res.golden == "missing" || res.regressed || res.n_open_edges > 0;
+				results.push_back(res);
+			}
+		}
+		if (gl)
+			voxelizer.term();
+	}
+	write_json(bench_args.json_file, results);
+	if (profh::get().is_enabled()) {
+		profh::get().resolve();
+		profh::get().write_report(stdout);
+		profh::get().write_chrome_trace(bench_args.profile_file);
+	}
+
+	if (gl)
+		oglh::terminate_window();
+	if (n_failures)
+		printf("%d regression check(s) failed\n", n_failures);
+	return n_failures ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#version 450
+
+// Raymarched occupancy viewer. Rays are traversed voxel by voxel (DDA) in grid space, where voxel k
+// spans [k, k + 1) and is centred on world k/res like the cubes of PolygonVS.glsl. Empty space is
+// skipped with the pyramid of VoxelMipCS.glsl: at level l a cell covers 2^l voxels per axis (level
+// 0 is the grid itself, level l > 0 is mip l - 1 of voxelMip). Occupied cells are descended into,
+// empty ones are stepped over and the next cell is tried one level up.
+layout(binding = 0) uniform usampler3D voxelOccupancy;
+layout(binding = 1) uniform usampler3D voxelMip;
+
+uniform ivec3 voxelResolution;
+uniform int nLevels;
+uniform mat4 inv_mvp_matrix;
+uniform mat4 view_matrix;
+
+in vec2 ndc;
+
+out vec4 frag_color;
+
+// same lighting as PolygonFS.glsl
+const vec3 la = vec3(0.3);
+const vec3 ld = vec3(0.5);
+const vec3 ls = vec3(0.1);
+const vec3 ka = vec3(1.0, 1.0, 1.0);
+const vec3 ks = vec3(1.0, 1.0, 1.0);
+const float shininess = 1.0;
+
+bool occupied(ivec3 cell, int level) {
+	if (level == 0)
+		return texelFetch(voxelOccupancy, cell, 0).x != 0;
+	if (any(greaterThanEqual(cell, textureSize(voxelMip, level - 1))))
+		return true;
+	return texelFetch(voxelMip, cell, level - 1).x != 0;
+}
+
+void main() {
+	vec3 res = vec3(voxelResolution);
+	vec4 near = inv_mvp_matrix*vec4(ndc, -1.0, 1.0);
+	vec4 far = inv_mvp_matrix*vec4(ndc, 1.0, 1.0);
+	vec3 ro = near.xyz/near.w*res + 0.5;
+	vec3 rd = normalize(far.xyz/far.w*res + 0.5 - ro);
+	rd += vec3(equal(rd, vec3(0.0)))*1e-7;
+	vec3 inv = 1.0/rd;
+
+	vec3 t0 = -ro*inv, t1 = (res - ro)*inv;
+	vec3 tMin = min(t0, t1), tMax = max(t0, t1);
+	float tEnter = max(max(max(tMin.x, tMin.y), tMin.z), 0.0);
+	float tExit = min(min(tMax.x, tMax.y), tMax.z);
+	if (tEnter >= tExit)
+		discard;
+
+	int axis = tMin.x > tMin.y ? (tMin.x > tMin.z ? 0 : 2) : (tMin.y > tMin.z ? 1 : 2);
+	int level = nLevels;
+	float t = tEnter;
+	bool hit = false;
+	int maxSteps = 4*(voxelResolution.x + voxelResolution.y + voxelResolution.z);
+	for (int i = 0; i < maxSteps && t < tExit; i++) {
+		vec3 p = clamp(ro + rd*(t + 1e-3), vec3(0.0), res - 1e-3);
+		float size = float(1 << level);
+		ivec3 cell = ivec3(floor(p/size));
+		if (occupied(cell, level)) {
+			if (level == 0) {
+				hit = true;
+				break;
+			}
+			level--;
+			continue;
+		}
+		vec3 tNext = ((vec3(cell) + step(0.0, rd))*size - ro)*inv;
+		axis = tNext.x < tNext.y ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+		t = tNext[axis];
+		level = min(level + 1, nLevels);
+	}
+	if (!hit)
+		discard;
+
+	// the face the ray entered the voxel through
+	vec3 normal = vec3(0.0);
+	normal[axis] = -sign(rd[axis]);
+	vec4 pos1 = view_matrix*vec4((ro + rd*t - 0.5)/res, 1.0);
+	vec3 position_vs = pos1.xyz/pos1.w;
+	vec3 normal1 = normalize(mat3(view_matrix)*normal);
+
+	vec3 frag_color_vs = vec3(0, 1, 1);
+	vec3 pos_light = -view_matrix[3].xyz;
+	vec3 s = normalize(pos_light - position_vs);
+	vec3 v = normalize(-position_vs);
+	vec3 r = reflect(-s, normal1);
+
+	float sDotN = max(dot(s, normal1), 0.0);
+	vec3 ambient = la*ka;
+	vec3 diffuse = ld*frag_color_vs*sDotN;
+	vec3 specular = vec3(0.0);
+	if (sDotN > 0.0)
+		specular = ls*ks*pow(max(dot(r, v), 0.0), shininess);
+
+	frag_color = vec4(diffuse + ambient + specular, 1);
+}
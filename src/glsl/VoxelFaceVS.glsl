@@ -0,0 +1,36 @@
+#version 450
+
+// one instance per exposed voxel face (see voxh::exposed_faces): voxel x, y, z and the face,
+// 0..5 for -x, +x, -y, +y, -z, +z. The quad of the face is built from gl_VertexID.
+layout (location = 0) in uvec4 face;
+
+uniform vec3 scale; // half size of a voxel cube
+uniform vec3 voxelSize;
+uniform mat4 modelview_matrix;
+uniform mat4 mvp_matrix;
+uniform mat3 normal_matrix;
+
+out vec3 position_vs;
+out vec3 normal_vs;
+
+// two counter-clockwise triangles seen from the +axis side
+const vec2 corners[6] = vec2[](vec2(-1, -1), vec2(1, -1), vec2(1, 1), vec2(-1, -1), vec2(1, 1), vec2(-1, 1));
+
+void main() {
+	int axis = int(face.w) >> 1;
+	float side = (face.w & 1u) == 1u ? 1.0 : -1.0;
+	vec2 c = corners[gl_VertexID];
+	c.x *= side; // mirrored (and so still counter-clockwise) on the -axis side
+
+	vec3 vertex, normal = vec3(0);
+	vertex[axis] = side;
+	vertex[(axis + 1) % 3] = c.x;
+	vertex[(axis + 2) % 3] = c.y;
+	normal[axis] = side;
+
+	vec4 p = vec4(vec3(face.xyz)*voxelSize + scale*vertex, 1.0);
+	gl_Position = mvp_matrix*p;
+	vec4 pos1 = modelview_matrix*p;
+	position_vs = pos1.xyz/pos1.w;
+	normal_vs = normal_matrix*normal;
+}
@@ -0,0 +1,34 @@
+////////////////////////////////////////////////////////////////////////////////
+// One level of the empty-space pyramid of the raymarched viewer: a cell is set
+// when any of its 2x2x2 children is. Level 0 is built from the occupancy grid,
+// every further level from the previous one. Mip sizes round down, so the
+// children of a cell past the end of a level are dropped and the raymarcher
+// treats such cells as occupied.
+////////////////////////////////////////////////////////////////////////////////
+
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+
+// UNIFORM (from OpenGL)
+uniform int sourceLevel;
+
+layout(binding = 0) uniform usampler3D source;
+layout(r8ui, binding = 6) writeonly uniform uimage3D destination;
+
+void main()
+{
+	ivec3 cell = ivec3(gl_GlobalInvocationID);
+	if (any(greaterThanEqual(cell, imageSize(destination))))
+		return;
+
+	ivec3 size = textureSize(source, sourceLevel);
+	uint occupied = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		ivec3 child = 2*cell + ivec3(i & 1, (i >> 1) & 1, i >> 2);
+		if (all(lessThan(child, size)))
+			occupied |= texelFetch(source, child, sourceLevel).x;
+	}
+	imageStore(destination, cell, uvec4(occupied != 0 ? 1 : 0));
+}
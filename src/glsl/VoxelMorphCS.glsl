@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////
+// One dilation or erosion pass over the occupancy grid (see volh::dilate). A
+// voxel is tested against every offset of the structuring element within the
+// box of half size extent: dilation sets it when any voxel under the element
+// is set, erosion clears it when any is empty. Outside the grid counts as
+// empty for dilation and as set for erosion, like on the CPU. Cubes run as
+// three passes along the axes, other shapes as a single pass.
+////////////////////////////////////////////////////////////////////////////////
+
+#version 450
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+
+// UNIFORM (from OpenGL)
+uniform ivec3 voxelResolution;
+uniform ivec3 extent;
+uniform int shape; // volh::Shape: 0 cube, 1 cross, 2 ball
+uniform int radius;
+uniform bool erode;
+
+layout(r8ui, binding = 0) readonly uniform uimage3D source;
+layout(r8ui, binding = 7) writeonly uniform uimage3D destination;
+
+bool inElement(ivec3 d)
+{
+	if (shape == 1)
+		return abs(d.x) + abs(d.y) + abs(d.z) <= radius;
+	if (shape == 2)
+		return dot(d, d) <= radius * radius;
+	return true;
+}
+
+void main()
+{
+	ivec3 voxel = ivec3(gl_GlobalInvocationID);
+	if (any(greaterThanEqual(voxel, voxelResolution)))
+		return;
+
+	// dilation looks for a set voxel, erosion for an empty one
+	bool found = false;
+	for (int dz = -extent.z; dz <= extent.z && !found; dz++)
+		for (int dy = -extent.y; dy <= extent.y && !found; dy++)
+			for (int dx = -extent.x; dx <= extent.x && !found; dx++)
+			{
+				ivec3 d = ivec3(dx, dy, dz);
+				ivec3 q = voxel + d;
+				if (!inElement(d) || any(lessThan(q, ivec3(0))) || any(greaterThanEqual(q, voxelResolution)))
+					continue;
+				found = (imageLoad(source, q).x != 0) != erode;
+			}
+	imageStore(destination, voxel, uvec4(found != erode ? 1 : 0));
+}
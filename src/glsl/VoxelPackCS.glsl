@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////
+// Packs the occupancy grid into bits for a readback of 1/8 of the dense size,
+// in the order of gridh::BitGrid: voxel i (x fastest) is bit i % 32 of word
+// i / 32, so on little-endian hosts two words form the uint64 of the .voxb
+// format. Bits past the last voxel are zero.
+////////////////////////////////////////////////////////////////////////////////
+
+#version 450
+
+layout(local_size_x = 256) in;
+
+// UNIFORM (from OpenGL)
+uniform ivec3 voxelResolution;
+uniform uint nWords;
+
+layout(r8ui, binding = 0) readonly uniform uimage3D voxelOccupancy;
+
+layout(std430, binding = 0) writeonly buffer Bits
+{
+	uint bits[];
+};
+
+void main()
+{
+	uint sx = uint(voxelResolution.x), sy = uint(voxelResolution.y);
+	// the dispatch is capped at the work group limit, so each invocation may write several words
+	uint stride = gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+	for (uint w = gl_GlobalInvocationID.x; w < nWords; w += stride)
+	{
+		// first voxel 32 * w, split into row (y + z * sy) and x without forming the linear
+		// index, which wraps at 2^32 voxels (e.g. 2048^3)
+		uint r = 32u * (w % sx);
+		uint row = 32u * (w / sx) + r / sx;
+		uint word = 0u;
+		ivec3 p = ivec3(r % sx, row % sy, row / sy);
+		for (uint b = 0u; b < 32u && p.z < voxelResolution.z; b++)
+		{
+			if (imageLoad(voxelOccupancy, p).x != 0u)
+				word |= 1u << b;
+			if (++p.x == voxelResolution.x)
+			{
+				p.x = 0;
+				if (++p.y == voxelResolution.y)
+				{
+					p.y = 0;
+					p.z++;
+				}
+			}
+		}
+		bits[w] = word;
+	}
+}
@@ -0,0 +1,35 @@
+////////////////////////////////////////////////////////////////////////////////
+// Point scatter of the sub-voxel triangle merging (see cpuvoxh::split_subvoxel).
+// Triangles lying within a single voxel skip the geometry shader, the voxels
+// they set arrive here as linear grid indices (x fastest) and are written as is.
+////////////////////////////////////////////////////////////////////////////////
+
+#version 450
+
+layout(local_size_x = 256) in;
+
+// UNIFORM (from OpenGL)
+uniform ivec3 voxelResolution;
+uniform uint nCells;
+
+layout(std430, binding = 0) readonly buffer Cells
+{
+	uint cells[];
+};
+
+//Voxel output (same binding as VoxelizationGS.glsl)
+layout(r8ui, binding = 0) uniform uimage3D voxelOccupancy;
+
+void main()
+{
+	// the dispatch is capped at the work group limit, so each invocation may write several cells
+	uint stride = gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+	for (uint i = gl_GlobalInvocationID.x; i < nCells; i += stride)
+	{
+		uint index = cells[i];
+		uint sx = uint(voxelResolution.x);
+		uint sy = uint(voxelResolution.y);
+		ivec3 coord = ivec3(index % sx, index / sx % sy, index / (sx * sy));
+		imageStore(voxelOccupancy, coord, uvec4(1));
+	}
+}
@@ -16,24 +16,58 @@
 // Fat voxelization is when adjacent voxels need to share at least a face
 #define FAT  1
 
+// selected by the host (see oglh::load_shader), thin by default
+#ifndef THICKNESS
 #define THICKNESS THIN
+#endif
+
+// Integer-snapped mode: vertices arrive as fixed-point voxel coordinates and the
+// triangle/voxel tests are evaluated exactly in 64-bit integers, which makes the
+// result independent of the GPU (mirrors cpuvoxh::voxelize_triangle_exact)
+#ifndef EXACT
+#define EXACT 0
+#endif
+
+#if EXACT
+#extension GL_ARB_gpu_shader_int64 : require
+// must match cpuvoxh::SUBVOXEL_BITS
+#define SUBVOXEL_SCALE 256l
+#endif
+
 
 // inputs from vertex shader
 layout(triangles) in;
 layout(triangle_strip, max_vertices = 3) out;
 
+// Fixed-point scale of the accumulated normals (see writeVoxels)
+#define NORMAL_FIXED_POINT_SCALE 65536.0
+
 // UNIFORM (from OpenGL)
 uniform ivec3 voxelResolution;
+uniform bool accumulateNormals;
+uniform bool writeLabels;
 
 //Voxel output
 layout(r8ui, binding = 0) uniform uimage3D voxelOccupancy;
 layout(rgba8, binding = 1) uniform image3D voxelColor;
+layout(r32i, binding = 2) uniform iimage3D voxelNormalX;
+layout(r32i, binding = 3) uniform iimage3D voxelNormalY;
+layout(r32i, binding = 4) uniform iimage3D voxelNormalZ;
+// scene object labels, the largest one wins so that the grid does not depend on the draw order
+layout(r32ui, binding = 5) uniform uimage3D voxelLabel;
 
 in block
 {
+#if EXACT
+	ivec3 vsVertexPosFixed;
+#else
 	vec3 vsVertexPos;
+#endif
+	uint vsObjectLabel;
 } In[];
 
+uint objectLabel;
+
 
 // Look-up table of permutations matrices used to reverse triangle swizzling and
 // restore vertices to their original orientation.
@@ -108,15 +142,77 @@ void swizzleTri(inout vec3 v0,
 	}
 }
 
-void writeVoxels(ivec3 coord, uint val, vec4 color)
+void writeVoxels(ivec3 coord, uint val, vec4 color, ivec3 normal)
 {
 	//modify as necessary for attributes/storage type
 	imageStore(voxelOccupancy, coord, uvec4(val));
 	imageStore(voxelColor, coord, color);
+	if (accumulateNormals)
+	{
+		imageAtomicAdd(voxelNormalX, coord, normal.x);
+		imageAtomicAdd(voxelNormalY, coord, normal.y);
+		imageAtomicAdd(voxelNormalZ, coord, normal.z);
+	}
+	if (writeLabels)
+		imageAtomicMax(voxelLabel, coord, objectLabel);
+}
+
+// area-weighted triangle normal in fixed-point, rotated back to the original
+// orientation. The area (in voxel units) is clamped to one voxel face since a
+// voxel never sees more of a triangle than that, which also bounds the sum.
+ivec3 fixedPointNormal(vec3 n, mat3 unswizzle)
+{
+	float len = length(n);
+	if (len == 0.0)
+		return ivec3(0);
+	float area = min(0.5*len, 1.0);
+	return ivec3(round(unswizzle*n/len*area*NORMAL_FIXED_POINT_SCALE));
+}
+
+// edge test of the per-cell loop at q with q[k] = t
+bool edgeTest(float d, vec2 n, vec2 q, int k, int t)
+{
+	q[k] = float(t);
+	return d + dot(n, q) >= 0;
+}
+
+// Narrows [lo, hi) to the t passing edgeTest. The edge function is monotone in t, so
+// the crossing is solved analytically and then fixed up with the test itself: the
+// span holds exactly the cells a per-cell test would accept (see cpuvoxh::clip_span).
+void clipSpan(inout int lo, inout int hi, float d, vec2 n, vec2 q, int k)
+{
+	if(lo >= hi)
+		return;
+	if(n[k] == 0)
+	{
+		if(!edgeTest(d, n, q, k, lo))
+			hi = lo;
+		return;
+	}
+	q[k] = 0;
+	int t = int(clamp(-(d + dot(n, q)) / n[k], float(lo), float(hi - 1)));
+	if(n[k] > 0)	//passes for t >= lo
+	{
+		if(edgeTest(d, n, q, k, t))
+			while(t > lo && edgeTest(d, n, q, k, t - 1)) t--;
+		else
+			do t++; while(t < hi && !edgeTest(d, n, q, k, t));
+		lo = t;
+	}
+	else			//passes for t < hi
+	{
+		if(edgeTest(d, n, q, k, t))
+			while(t < hi - 1 && edgeTest(d, n, q, k, t + 1)) t++;
+		else
+			do t--; while(t >= lo && !edgeTest(d, n, q, k, t));
+		hi = t + 1;
+	}
 }
 
 void voxelizeTriPostSwizzle(vec3 v0, vec3 v1, vec3 v2, vec3 n, mat3 unswizzle, ivec3 minVoxIndex, ivec3 maxVoxIndex)
 {
+	ivec3 nFixed = accumulateNormals ? fixedPointNormal(n, unswizzle) : ivec3(0);
+
 	vec3 e0 = v1 - v0;	//figure 17/18 line 2
 	vec3 e1 = v2 - v1;	//figure 17/18 line 2
 	vec3 e2 = v0 - v2;	//figure 17/18 line 2
@@ -180,59 +276,233 @@ void voxelizeTriPostSwizzle(vec3 v0, vec3 v1, vec3 v2, vec3 n, mat3 unswizzle, i
 	float zMinFloor, zMaxCeil;	//voxel Z-intersection floor/ceil
 	for(p.x = minVoxIndex.x; p.x < maxVoxIndex.x; p.x++)	//figure 17 line 13, figure 18 line 12
 	{
-		for(p.y = minVoxIndex.y; p.y < maxVoxIndex.y; p.y++)	//figure 17 line 14, figure 18 line 13
+		//y-interval of the column inside the xy edges (figure 17 line 15, figure 18 line 14)
+		int yLo = minVoxIndex.y, yHi = maxVoxIndex.y;
+		clipSpan(yLo, yHi, d_e0_xy, n_e0_xy, vec2(p.x, 0), 1);
+		clipSpan(yLo, yHi, d_e1_xy, n_e1_xy, vec2(p.x, 0), 1);
+		clipSpan(yLo, yHi, d_e2_xy, n_e2_xy, vec2(p.x, 0), 1);
+
+		//z-interval of the column inside the zx edges
+		int zxLo = minVoxIndex.z, zxHi = maxVoxIndex.z;
+		clipSpan(zxLo, zxHi, d_e0_zx, n_e0_zx, vec2(0, p.x), 0);
+		clipSpan(zxLo, zxHi, d_e1_zx, n_e1_zx, vec2(0, p.x), 0);
+		clipSpan(zxLo, zxHi, d_e2_zx, n_e2_zx, vec2(0, p.x), 0);
+
+		for(p.y = yLo; p.y < yHi && zxLo < zxHi; p.y++)	//figure 17 line 14, figure 18 line 13
 		{
-			float dd_e0_xy = d_e0_xy + dot(n_e0_xy, p.xy);
-			float dd_e1_xy = d_e1_xy + dot(n_e1_xy, p.xy);
-			float dd_e2_xy = d_e2_xy + dot(n_e2_xy, p.xy);
-		
-			bool xy_overlap = (dd_e0_xy >= 0) && (dd_e1_xy >= 0) && (dd_e2_xy >= 0);
-
-			if(xy_overlap)	//figure 17 line 15, figure 18 line 14
-			{
-				float dot_n_p = dot(nProj.xy, p.xy);
+			float dot_n_p = dot(nProj.xy, p.xy);
 #if THICKNESS == THIN
-				zMinInt = (-dot_n_p + dTriThin) * nzInv;
-				zMaxInt = zMinInt;
+			zMinInt = (-dot_n_p + dTriThin) * nzInv;
+			zMaxInt = zMinInt;
 #elif THICKNESS == FAT
-				zMinInt = (-dot_n_p + dTriFatMin) * nzInv;
-				zMaxInt = (-dot_n_p + dTriFatMax) * nzInv;
+			zMinInt = (-dot_n_p + dTriFatMin) * nzInv;
+			zMaxInt = (-dot_n_p + dTriFatMax) * nzInv;
 #endif
-				zMinFloor = floor(zMinInt);
-				zMaxCeil  =  ceil(zMaxInt);
-
-				zMin = int(zMinFloor) - int(zMinFloor == zMinInt);
-				zMax = int(zMaxCeil ) + int(zMaxCeil  == zMaxInt);
-
-				zMin = max(minVoxIndex.z, zMin);	//clamp to bounding box max Z
-				zMax = min(maxVoxIndex.z, zMax);	//clamp to bounding box min Z
-
-				for(p.z = zMin; p.z < zMax; p.z++)	//figure 17/18 line 18
-				{
-					float dd_e0_yz = d_e0_yz + dot(n_e0_yz, p.yz);
-					float dd_e1_yz = d_e1_yz + dot(n_e1_yz, p.yz);
-					float dd_e2_yz = d_e2_yz + dot(n_e2_yz, p.yz);
-
-					float dd_e0_zx = d_e0_zx + dot(n_e0_zx, p.zx);
-					float dd_e1_zx = d_e1_zx + dot(n_e1_zx, p.zx);
-					float dd_e2_zx = d_e2_zx + dot(n_e2_zx, p.zx);
-
-					bool yz_overlap = (dd_e0_yz >= 0) && (dd_e1_yz >= 0) && (dd_e2_yz >= 0);
-					bool zx_overlap = (dd_e0_zx >= 0) && (dd_e1_zx >= 0) && (dd_e2_zx >= 0);
-
-					if(yz_overlap && zx_overlap)	//figure 17/18 line 19
-					{
-						writeVoxels(ivec3(unswizzle*p), 1,
-									vec4(unswizzle*p/voxelResolution,1));	//figure 17/18 line 20
-					}
-				} //z-loop
-			} //xy-overlap test
+			zMinFloor = floor(zMinInt);
+			zMaxCeil  =  ceil(zMaxInt);
+
+			zMin = int(zMinFloor) - int(zMinFloor == zMinInt);
+			zMax = int(zMaxCeil ) + int(zMaxCeil  == zMaxInt);
+
+			zMin = max(zxLo, zMin);	//clamp to bounding box / zx edges min Z
+			zMax = min(zxHi, zMax);	//clamp to bounding box / zx edges max Z
+
+			//z-interval of the row inside the yz edges
+			clipSpan(zMin, zMax, d_e0_yz, n_e0_yz, vec2(p.y, 0), 1);
+			clipSpan(zMin, zMax, d_e1_yz, n_e1_yz, vec2(p.y, 0), 1);
+			clipSpan(zMin, zMax, d_e2_yz, n_e2_yz, vec2(p.y, 0), 1);
+
+			for(p.z = zMin; p.z < zMax; p.z++)	//figure 17/18 line 18
+			{
+				writeVoxels(ivec3(unswizzle*p), 1,
+							vec4(unswizzle*p/voxelResolution,1), nFixed);	//figure 17/18 line 20
+			}
 		} //y-loop
 	} //x-loop
 }
 
+#if EXACT
+int64_t dot64(i64vec2 a, i64vec2 b)
+{
+	return a.x*b.x + a.y*b.y;
+}
+
+// floor(num/den) for den > 0, exact is set when den divides num
+int64_t floorDiv(int64_t num, int64_t den, out bool exact)
+{
+	int64_t q = abs(num)/den;
+	exact = q*den == abs(num);
+	return (num >= 0) ? q : (exact ? -q : -q - 1);
+}
+
+int64_t ceilDiv(int64_t num, int64_t den, out bool exact)
+{
+	return -floorDiv(-num, den, exact);
+}
+
+// voxel z-range [zMin, zMax) of the plane slab num/den (see cpuvoxh::plane_z_range)
+void planeZRange(int64_t numMin, int64_t numMax, int64_t den, out int zMin, out int zMax)
+{
+	bool exact;
+	zMin = int(floorDiv(numMin, den, exact));
+	zMin -= int(exact);
+	zMax = int( ceilDiv(numMax, den, exact));
+	zMax += int(exact);
+}
+
+// clipSpan for the exact edge test c + n*t*SUBVOXEL_SCALE >= 0, the crossing is a plain division
+void clipSpanExact(inout int lo, inout int hi, int64_t n, int64_t c)
+{
+	bool exact;
+	if(lo >= hi)
+		return;
+	if(n > 0)
+		lo = int(clamp(ceilDiv(-c, n*SUBVOXEL_SCALE, exact), int64_t(lo), int64_t(hi)));
+	else if(n < 0)
+		hi = int(clamp(floorDiv(c, -n*SUBVOXEL_SCALE, exact) + 1, int64_t(lo), int64_t(hi)));
+	else if(c < 0)
+		hi = lo;
+}
+
+// same as swizzleTri on fixed-point vertices
+void swizzleTriExact(inout i64vec3 v0,
+					 inout i64vec3 v1,
+					 inout i64vec3 v2,
+					 out i64vec3 n,
+					 out mat3 unswizzle)
+{
+	i64vec3 e0 = v1 - v0;
+	i64vec3 e1 = v2 - v1;
+	n = e0.yzx*e1.zxy - e0.zxy*e1.yzx;
+
+	i64vec3 absN = abs(n);
+	if(absN.x >= absN.y && absN.x >= absN.z)
+	{
+		v0.xyz = v0.yzx; v1.xyz = v1.yzx; v2.xyz = v2.yzx; n.xyz = n.yzx;
+		unswizzle = unswizzleLUT[0];
+	}
+	else if(absN.y >= absN.x && absN.y >= absN.z)
+	{
+		v0.xyz = v0.zxy; v1.xyz = v1.zxy; v2.xyz = v2.zxy; n.xyz = n.zxy;
+		unswizzle = unswizzleLUT[1];
+	}
+	else
+	{
+		unswizzle = unswizzleLUT[2];
+	}
+}
+
+// voxelizeTriPostSwizzle with every quantity scaled by SUBVOXEL_SCALE^k so
+// that it stays integral: edge normals s^2, edge offsets s^3, plane offsets s^3
+void voxelizeTriExact(i64vec3 v0, i64vec3 v1, i64vec3 v2, i64vec3 n, mat3 unswizzle, ivec3 minVoxIndex, ivec3 maxVoxIndex)
+{
+	const int64_t s = SUBVOXEL_SCALE;
+	const int64_t h = SUBVOXEL_SCALE/2;
+
+	ivec3 nFixed = accumulateNormals ? fixedPointNormal(vec3(n)/float(s*s), unswizzle) : ivec3(0);
+
+	i64vec3 e[3] = i64vec3[](v1 - v0, v2 - v1, v0 - v2);
+	i64vec3 v[3] = i64vec3[](v0, v1, v2);
+
+	//INward Facing edge normals XY, YZ, ZX and their offsets
+	i64vec2 n_xy[3], n_yz[3], n_zx[3];
+	int64_t d_xy[3], d_yz[3], d_zx[3];
+	for(int i = 0; i < 3; i++)
+	{
+		n_xy[i] = (n.z >= 0) ? i64vec2(-e[i].y, e[i].x) : i64vec2(e[i].y, -e[i].x);
+		n_yz[i] = (n.x >= 0) ? i64vec2(-e[i].z, e[i].y) : i64vec2(e[i].z, -e[i].y);
+		n_zx[i] = (n.y >= 0) ? i64vec2(-e[i].x, e[i].z) : i64vec2(e[i].x, -e[i].z);
+#if THICKNESS == THIN
+		d_xy[i] = dot64(n_xy[i], h - v[i].xy) + h * max(abs(n_xy[i].x), abs(n_xy[i].y));
+		d_yz[i] = dot64(n_yz[i], h - v[i].yz) + h * max(abs(n_yz[i].x), abs(n_yz[i].y));
+		d_zx[i] = dot64(n_zx[i], h - v[i].zx) + h * max(abs(n_zx[i].x), abs(n_zx[i].y));
+#elif THICKNESS == FAT
+		d_xy[i] = -dot64(n_xy[i], v[i].xy) + s * (max(n_xy[i].x, 0l) + max(n_xy[i].y, 0l));
+		d_yz[i] = -dot64(n_yz[i], v[i].yz) + s * (max(n_yz[i].x, 0l) + max(n_yz[i].y, 0l));
+		d_zx[i] = -dot64(n_zx[i], v[i].zx) + s * (max(n_zx[i].x, 0l) + max(n_zx[i].y, 0l));
+#endif
+	}
+
+	i64vec3 nProj = (n.z < 0) ? -n : n;
+
+	const int64_t dTri = dot64(nProj.xy, v0.xy) + nProj.z*v0.z;
+#if THICKNESS == THIN
+	const int64_t dTriMin = dTri - h * (nProj.x + nProj.y);
+	const int64_t dTriMax = dTriMin;
+#elif THICKNESS == FAT
+	const int64_t dTriMin = dTri - s * (max(nProj.x, 0l) + max(nProj.y, 0l));
+	const int64_t dTriMax = dTri - s * (min(nProj.x, 0l) + min(nProj.y, 0l));
+#endif
+	const int64_t den = nProj.z * s;
+
+	ivec3 p;
+	for(p.x = minVoxIndex.x; p.x < maxVoxIndex.x; p.x++)
+	{
+		int64_t px = int64_t(p.x) * s;
+		int yLo = minVoxIndex.y, yHi = maxVoxIndex.y;
+		int zxLo = minVoxIndex.z, zxHi = maxVoxIndex.z;
+		for(int i = 0; i < 3; i++)
+		{
+			clipSpanExact(yLo, yHi, n_xy[i].y, d_xy[i] + n_xy[i].x*px);
+			clipSpanExact(zxLo, zxHi, n_zx[i].x, d_zx[i] + n_zx[i].y*px);
+		}
+		if(yLo >= yHi || zxLo >= zxHi)
+			continue;
+
+		//edge and plane values stepped along y, exact in integers
+		int64_t c_yz[3];
+		for(int i = 0; i < 3; i++)
+			c_yz[i] = d_yz[i] + n_yz[i].x*int64_t(yLo)*s;
+		int64_t dot_n_p = nProj.x*px + nProj.y*int64_t(yLo)*s;
+		for(p.y = yLo; p.y < yHi; p.y++, dot_n_p += nProj.y*s)
+		{
+			int zMin, zMax;
+			planeZRange(dTriMin - dot_n_p, dTriMax - dot_n_p, den, zMin, zMax);
+			zMin = max(zxLo, zMin);
+			zMax = min(zxHi, zMax);
+			for(int i = 0; i < 3; i++)
+			{
+				clipSpanExact(zMin, zMax, n_yz[i].y, c_yz[i]);
+				c_yz[i] += n_yz[i].x*s;
+			}
+
+			for(p.z = zMin; p.z < zMax; p.z++)
+			{
+				writeVoxels(ivec3(unswizzle*p), 1,
+							vec4(unswizzle*p/voxelResolution,1), nFixed);
+			}
+		}
+	}
+}
+#endif
+
 void main()
 {
+	objectLabel = In[0].vsObjectLabel;
+#if EXACT
+	i64vec3 n;
+	mat3 unswizzle;
+	i64vec3 v0 = i64vec3(In[0].vsVertexPosFixed);
+	i64vec3 v1 = i64vec3(In[1].vsVertexPosFixed);
+	i64vec3 v2 = i64vec3(In[2].vsVertexPosFixed);
+
+	swizzleTriExact(v0, v1, v2, n, unswizzle);
+	if(n == i64vec3(0))	//degenerate, no well defined plane
+		return;
+
+	i64vec3 AABBmin = min(min(v0, v1), v2);
+	i64vec3 AABBmax = max(max(v0, v1), v2);
+
+	ivec3 res = ivec3(transpose(unswizzle)*vec3(voxelResolution));	//swizzled resolution
+	ivec3 minVoxIndex, maxVoxIndex;
+	bool exact;
+	for(int i = 0; i < 3; i++)
+	{
+		minVoxIndex[i] = clamp(int(floorDiv(AABBmin[i], SUBVOXEL_SCALE, exact)), 0, res[i]);
+		maxVoxIndex[i] = clamp(int( ceilDiv(AABBmax[i], SUBVOXEL_SCALE, exact)), 0, res[i]);
+	}
+	voxelizeTriExact(v0, v1, v2, n, unswizzle, minVoxIndex, maxVoxIndex);
+#else
 	vec3 n;
 	mat3 unswizzle;
 	vec3 v0 = In[0].vsVertexPos;
@@ -244,8 +514,9 @@ void main()
 	vec3 AABBmin = min(min(v0, v1), v2);
 	vec3 AABBmax = max(max(v0, v1), v2);
 
-	ivec3 minVoxIndex = ivec3(clamp(floor(AABBmin), ivec3(0), voxelResolution));
-	ivec3 maxVoxIndex = ivec3(clamp( ceil(AABBmax), ivec3(0), voxelResolution));
+	ivec3 res = ivec3(transpose(unswizzle)*vec3(voxelResolution));	//swizzled resolution
+	ivec3 minVoxIndex = ivec3(clamp(floor(AABBmin), vec3(0), vec3(res)));
+	ivec3 maxVoxIndex = ivec3(clamp( ceil(AABBmax), vec3(0), vec3(res)));
 
 	ivec3 isize = imageSize(voxelOccupancy);
 	//imageStore(voxelOccupancy, ivec3(0, 0, 0), uvec4(voxelResolution.x));
@@ -255,5 +526,5 @@ void main()
 	//imageStore(voxelOccupancy, ivec3(0, 2, 0), uvec4(AABBmax.y + 1));
 	//imageStore(voxelOccupancy, ivec3(0, 3, 0), uvec4(AABBmax.z + 1));
 	voxelizeTriPostSwizzle(v0, v1, v2, n, unswizzle, minVoxIndex, maxVoxIndex);
+#endif
 }
-
@@ -1,14 +1,30 @@
 #version 420
 
+// integer-snapped positions (see VoxelizationGS.glsl), selected by the host
+#ifndef EXACT
+#define EXACT 0
+#endif
+
 // IN (from OpenGL)
+#if EXACT
+layout(location = 0) in ivec3 position; // voxel space, 1/SUBVOXEL_SCALE voxel units
+#else
 layout(location = 0) in vec3 position;
+#endif
+// scene object label (see voxh::Voxelizer::upload_scene), instanced attribute
+layout(location = 1) in uint objectLabel;
 
 // Input uniforms
 uniform ivec3 voxelResolution;
 
 out block
 {
+#if EXACT
+	ivec3 vsVertexPosFixed; // fixed-point voxel-space vertex position
+#else
 	vec3 vsVertexPos; // voxel-space vertex position
+#endif
+	uint vsObjectLabel;
 } Out;
 
 out gl_PerVertex
@@ -16,13 +32,20 @@ out gl_PerVertex
 	vec4 gl_Position;
 };
 
+#define SUBVOXEL_SCALE 256.0
+
 void main()
 {
+	Out.vsObjectLabel = objectLabel;
+#if EXACT
+	Out.vsVertexPosFixed = position;
+	gl_Position = vec4(vec3(position) / (SUBVOXEL_SCALE * voxelResolution), 1);
+#else
 	// model vertices are defined in the unit cube
 	vec4 lsVertexPos = vec4(position, 1);
 	// translate them to voxel space
 	Out.vsVertexPos = lsVertexPos.xyz * voxelResolution;
 	
 	gl_Position = lsVertexPos;
+#endif
 }
-
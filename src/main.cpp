@@ -12,37 +12,48 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 
+#define TINYOBJLOADER_IMPLEMENTATION
 #include "OpenGLHelper.h"
 #include "CameraHelper.h"
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
-#include "tinyply.h"
+#include "MeshHelper.h"
+#include "VoxelHelper.h"
+#include "GridHelper.h"
+#include "SurfaceHelper.h"
+#include "VolumeHelper.h"
 
 #define WINDOW_HEIGHT 960
 #define WINDOW_WIDTH 1280 
 
+enum ViewMode { VIEW_CUBES, VIEW_FACES, VIEW_RAYMARCH };
+
 struct InputArgs {
 	std::string input_file;
 	std::string output_file;
+	std::string normals_file;
+	std::string profile_file;
+	std::string labels_file;
+	std::string mesh_file;
+	bool surface_nets = false;
+	int repair = -1; // close radius of -repair, off when negative
+	std::vector<volh::MorphOp> morph;
+	bool morph_cpu = false;
+	int components = 0; // connectivity of -components, off when 0
+	std::string component_labels_file;
+	cpuvoxh::Thickness thickness = cpuvoxh::THIN;
+	bool exact = false;
+	bool clean = false;
+	bool merge = false;
+	bool compress = false;
+	ViewMode view = VIEW_CUBES;
 	int dim;
 } input_args;
 
-struct Mesh {
-	Eigen::Matrix<float, -1, -1> V;
-	Eigen::Matrix<uint32_t, -1, -1> F;
-};
-
-
 struct RenderVAO {
 	GLuint program;
 	GLuint id_vao, id_vbo_vertex, id_vbo_normal, id_vbo_position;
-
-};
-
-struct VoxelizationVAO {
-	GLuint program;
-	GLuint id_vao, id_vbo_position, id_ebo, id_image_occupany, id_image_color;
+	GLuint id_vbo_face; // -view faces
+	GLuint mip_program, id_image_mip; // -view raymarch
+	int n_mip_levels;
 
 };
 
@@ -50,7 +61,7 @@ class ToyWorld {
 public:
 
     void term() {
-        
+		voxelizer.term();
     }
 	
 	void init() {
@@ -60,87 +71,34 @@ public:
 	}
 	
 	void load_mesh() {
-		if (input_args.input_file.find(".obj") != std::string::npos) { 
-			tinyobj::attrib_t attrib;
-        	std::string filename = input_args.input_file;
-			std::vector<tinyobj::shape_t> shapes;
-			std::vector<tinyobj::material_t> materials;
-			std::string err;
-			bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str());
-    		assert(ret);
-			
-			std::vector<int> Ftmp;
-
-			// Loop over shapes
-			for (size_t s = 0; s < shapes.size(); s++) {
-				// Loop over faces(polygon)
-				size_t index_offset = 0;
-				for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-					int fv = shapes[s].mesh.num_face_vertices[f];
-
-					// Loop over vertices in the face.
-					for (size_t v = 0; v < fv; v++) {
-						// access to vertex
-						Ftmp.push_back(shapes[s].mesh.indices[index_offset + v].vertex_index);
-					}
-					index_offset += fv;
-				}	
+		{
+			profh::HostScope scope("load_mesh");
+			if (is_scene()) {
+				if (!meshh::load_scene(input_args.input_file, scene))
+					std::exit(1);
+			} else {
+				meshh::load_mesh(input_args.input_file, mesh);
 			}
-			
-			mesh.F.resize(3, Ftmp.size()/3);	
-			std::copy(Ftmp.begin(), Ftmp.end(), mesh.F.data());
-			mesh.V.resize(3, attrib.vertices.size()/3);	
-			for (int i = 0; i < (int)attrib.vertices.size(); i++)
-				mesh.V(i) = attrib.vertices[i];
-			
-			printf("n-faces: %d\n", mesh.F.cols());
-			printf("n-verts: %d\n", mesh.V.cols());
-
-		} else if (input_args.input_file.find(".ply") != std::string::npos) { 
-		    std::ifstream ss(input_args.input_file);
-		    tinyply::PlyFile file(ss);
-			std::vector<float> verts;
-			std::vector<uint32_t> faces;
-		    int n_vertices = file.request_properties_from_element("vertex", { "x", "y", "z" }, verts);
-		    // Try getting vertex_indices or vertex_index
-		    int n_indices = file.request_properties_from_element("face", { "vertex_indices" }, faces, 3);
-		    if (n_indices == 0)
-		      n_indices = file.request_properties_from_element("face", { "vertex_index" }, faces, 3);
-    		file.read(ss);
-			mesh.V = Eigen::Map<Eigen::Matrix<float, -1, -1>>(verts.data(), 3, n_vertices);
-			mesh.F = Eigen::Map<Eigen::Matrix<uint32_t, -1, -1>>(faces.data(), 3, n_indices);
-		} else {
-			fprintf(stderr, "Error: Mesh format not known.\n");
-			exit(1);
 		}
-		assert(mesh.V.cols() > 0 && mesh.F.cols() > 0 && "Error loading mesh.");
-
-		float xmin = 1e9, xmax = 1e-9, ymin = 1e9, ymax = 1e-9, zmin = 1e9, zmax = 1e-9;
-		for (int i = 0; i < mesh.V.cols(); i++) {
-			xmin = mesh.V(0, i) < xmin ? mesh.V(0, i) : xmin;
-			ymin = mesh.V(1, i) < ymin ? mesh.V(1, i) : ymin;
-			zmin = mesh.V(2, i) < zmin ? mesh.V(2, i) : zmin;
-			xmax = mesh.V(0, i) > xmax ? mesh.V(0, i) : xmax;
-			ymax = mesh.V(1, i) > ymax ? mesh.V(1, i) : ymax;
-			zmax = mesh.V(2, i) > zmax ? mesh.V(2, i) : zmax;
+		if (is_scene()) {
+			// the objects keep their placement, the scene as a whole is fit into the unit cube
+			profh::HostScope scope("normalization");
+			meshh::normalize_mesh(scene.mesh);
+		} else if (input_args.clean) {
+			profh::HostScope scope("normalization_clean");
+			meshh::CleanStats stats;
+			meshh::normalize_clean_mesh(mesh, stats);
+			meshh::print_clean_stats(stats);
+		} else {
+			profh::HostScope scope("normalization");
+			meshh::normalize_mesh(mesh);
 		}
-		
-		float dx = (xmax - xmin);
-		float dy = (ymax - ymin);
-		float dz = (zmax - zmin);
-		float dmax = std::max(std::max(dx, dy), dz);
+
 		
 		voxelResolution[0] = input_args.dim;
 		voxelResolution[1] = input_args.dim;
 		voxelResolution[2] = input_args.dim;
 		printf("dimx: %d dimy: %d dimz: %d\n", voxelResolution[0], voxelResolution[1], voxelResolution[2]);
-		
-		for (int i = 0; i < mesh.V.cols(); i++) {
-			mesh.V(0, i) = (mesh.V(0, i) - xmin)/dmax;
-			mesh.V(1, i) = (mesh.V(1, i) - ymin)/dmax;
-			mesh.V(2, i) = (mesh.V(2, i) - zmin)/dmax;
-		}
-		
 	}
 	
 	void init_render_vao() {
@@ -152,11 +110,16 @@ public:
 		view_matrix = oglh::make_view_matrix<Eigen::Vector3f>(eye, lookat, up);	
 		projection_matrix = oglh::make_perspective_matrix<float>(60.0f, ar, 0.3f, 50.0f); 	
 		//projection_matrix = oglh::make_ortho_matrix<float>(-1, 1, -1, 1, 0.3, 50); 	
+
+		if (input_args.view == VIEW_RAYMARCH) {
+			init_raymarch();
+			return;
+		}
 		
 		
         std::string dir = std::string(HOMEDIR) + "/src/glsl/";
 		GLuint vs = 0, fs = 0;
-		oglh::load_shader(vs, dir + "/PolygonVS.glsl", GL_VERTEX_SHADER);
+		oglh::load_shader(vs, dir + (input_args.view == VIEW_FACES ? "/VoxelFaceVS.glsl" : "/PolygonVS.glsl"), GL_VERTEX_SHADER);
 		oglh::load_shader(fs, dir + "/PolygonFS.glsl", GL_FRAGMENT_SHADER);
 		GLuint shaders[2] = {vs, fs};
 		oglh::create_program(vao_render.program, shaders, 2);
@@ -213,122 +176,176 @@ public:
 		// -> position (buffer object) 
         glGenBuffers(1, &vao_render.id_vbo_position);
         glBindBuffer(GL_ARRAY_BUFFER, vao_render.id_vbo_position);
-        glBufferData(GL_ARRAY_BUFFER, n_size*3*sizeof(GLfloat), position.data(), GL_STATIC_DRAW);
+        if (input_args.view == VIEW_CUBES)
+            glBufferData(GL_ARRAY_BUFFER, n_size*3*sizeof(GLfloat), position.data(), GL_STATIC_DRAW);
         glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glEnableVertexAttribArray(2);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         // <-
 
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
-	}
-
-    void init_voxelization_vao() {
-	
-        std::string dir = std::string(HOMEDIR) + "/src/glsl/";
-		GLuint vs = 0, gs = 0, fs = 0;
-		oglh::load_shader(vs, dir + "/VoxelizationVS.glsl", GL_VERTEX_SHADER);
-		oglh::load_shader(gs, dir + "/VoxelizationGS.glsl", GL_GEOMETRY_SHADER);
-		oglh::load_shader(fs, dir + "/VoxelizationFS.glsl", GL_FRAGMENT_SHADER);
-		GLuint shaders[3] = {vs, gs, fs};
-		oglh::create_program(vao_voxelization.program, shaders, 3);
-        glUseProgram(vao_voxelization.program);
-        glGenVertexArrays(1, &vao_voxelization.id_vao);
-        glBindVertexArray(vao_voxelization.id_vao);
-		
-		// -> position (buffer object) 
-        glGenBuffers(1, &vao_voxelization.id_vbo_position);
-        glBindBuffer(GL_ARRAY_BUFFER, vao_voxelization.id_vbo_position);
-        glBufferData(GL_ARRAY_BUFFER, mesh.F.cols()*3*sizeof(GLfloat), mesh.V.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(0);
+		// -> exposed faces (buffer object), 4 x uint16 per instance
+        glGenBuffers(1, &vao_render.id_vbo_face);
+        glBindBuffer(GL_ARRAY_BUFFER, vao_render.id_vbo_face);
+        glBufferData(GL_ARRAY_BUFFER, face.size()*sizeof(GLushort), face.data(), GL_STATIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         // <-
 
-    	// -> elements (buffer object) 
-        glGenBuffers(1, &vao_voxelization.id_ebo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vao_voxelization.id_ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.F.cols()*3*sizeof(GLuint), mesh.F.data(), GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-        // <-
-		
-	
-
-		std::vector<uint8_t> image(voxelResolution[0]*voxelResolution[1]*voxelResolution[2], 0);
-		//std::iota(image.begin(), image.end(), 1);
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-		// -> Occuancy Grid 
-        glActiveTexture(GL_TEXTURE0);
-        glGenTextures(1, &vao_voxelization.id_image_occupany);
-        glBindTexture(GL_TEXTURE_3D, vao_voxelization.id_image_occupany);
-        glTexStorage3D(GL_TEXTURE_3D, 1, GL_R8UI, voxelResolution[0], voxelResolution[1], voxelResolution[2]);
-        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, voxelResolution[0], voxelResolution[1], voxelResolution[2], GL_RED_INTEGER, GL_UNSIGNED_BYTE, image.data());
-        glBindImageTexture(0, vao_voxelization.id_image_occupany, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R8UI);
-		// <-
-		
-		//// -> Color Grid 
-        //glActiveTexture(GL_TEXTURE1);
-        //glGenTextures(1, &vao_voxelization.id_image_color);
-        //glBindTexture(GL_TEXTURE_3D, vao_voxelization.id_image_color);
-        //glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA8, voxelResolution[0], voxelResolution[1], voxelResolution[2]);
-        ////glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GL_RGB, GL_UNSIGNED_BYTE, image.data.data());
-        //glBindImageTexture(1, vao_voxelization.id_image_color, 0, GL_TRUE, 0, GL_READ_WRITE, GL_RGBA8);
-		//// <-
-		
-		voxelize();
-		glMemoryBarrier(GL_ALL_BARRIER_BITS);
-		
-		glPixelStorei(GL_PACK_ALIGNMENT, 1);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_3D, vao_voxelization.id_image_occupany);
-		glGetTexImage(GL_TEXTURE_3D, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, image.data());
-		glMemoryBarrier(GL_ALL_BARRIER_BITS);
+		glEnable(GL_DEPTH_TEST);
+		glEnable(GL_CULL_FACE);
+	}
 
-		int sum = std::accumulate(image.begin(), image.end(), 0);
+	// the grid stays in its texture, only the empty-space pyramid (1/7 of its size) is added
+	void init_raymarch() {
+		std::string dir = std::string(HOMEDIR) + "/src/glsl/";
+		GLuint vs = 0, fs = 0, cs = 0;
+		oglh::load_shader(vs, dir + "/RaymarchVS.glsl", GL_VERTEX_SHADER);
+		oglh::load_shader(fs, dir + "/RaymarchFS.glsl", GL_FRAGMENT_SHADER);
+		GLuint shaders[2] = {vs, fs};
+		oglh::create_program(vao_render.program, shaders, 2);
+		oglh::load_shader(cs, dir + "/VoxelMipCS.glsl", GL_COMPUTE_SHADER);
+		oglh::create_program(vao_render.mip_program, &cs, 1);
+		glGenVertexArrays(1, &vao_render.id_vao); // the screen triangle has no attributes
+
+		// integer textures are only complete with nearest filtering
+		GLuint occupancy = voxelizer.vao.id_image_occupany;
+		glBindTexture(GL_TEXTURE_3D, occupancy);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		int size[3];
+		for (int i = 0; i < 3; i++)
+			size[i] = (voxelResolution[i] + 1)/2;
+		vao_render.n_mip_levels = 0;
+		for (int m = std::max(size[0], std::max(size[1], size[2])); m; m >>= 1)
+			vao_render.n_mip_levels++;
+		glGenTextures(1, &vao_render.id_image_mip);
+		glBindTexture(GL_TEXTURE_3D, vao_render.id_image_mip);
+		glTexStorage3D(GL_TEXTURE_3D, vao_render.n_mip_levels, GL_R8UI, size[0], size[1], size[2]);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glUseProgram(vao_render.mip_program);
+		glActiveTexture(GL_TEXTURE0);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		for (int level = 0; level < vao_render.n_mip_levels; level++) {
+			glBindTexture(GL_TEXTURE_3D, level == 0 ? occupancy : vao_render.id_image_mip);
+			glUniform1i(glGetUniformLocation(vao_render.mip_program, "sourceLevel"), std::max(level - 1, 0));
+			glBindImageTexture(6, vao_render.id_image_mip, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_R8UI);
+			int groups[3];
+			for (int i = 0; i < 3; i++)
+				groups[i] = (std::max(size[i] >> level, 1) + 7)/8;
+			glDispatchCompute(groups[0], groups[1], groups[2]);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+		glBindTexture(GL_TEXTURE_3D, 0);
+	}
 
+    void init_voxelization_vao() {
+		voxelizer.init(input_args.thickness, input_args.exact, input_args.merge, input_args.compress);
+		if (is_scene())
+			voxelizer.upload_scene(scene);
+		else
+			voxelizer.upload_mesh(mesh);
+		voxelizer.init_grid(voxelResolution, !input_args.normals_file.empty(), !input_args.labels_file.empty());
+		voxelizer.voxelize();
+		if (!input_args.morph.empty() && !input_args.morph_cpu)
+			voxelizer.morph(input_args.morph);
+
+		// the raymarched view samples the grid texture, so with -out none nothing is read back
+		std::vector<uint8_t> image;
 		n_size = 0;
-		for (int i = 0; i < voxelResolution[2]; i++) {
-			for (int j = 0; j < voxelResolution[1]; j++) {
-				for (int k = 0; k < voxelResolution[0]; k++) {
-					int index = i*voxelResolution[1]*voxelResolution[0] + j*voxelResolution[0] + k;
-					if (image[index]) {
-						position.push_back((float)k/voxelResolution[0]);	
-						position.push_back((float)j/voxelResolution[1]);	
-						position.push_back((float)i/voxelResolution[2]);	
-						//printf("v: %d x: %d y: %d z: %d\n", image[index], k, j, i);
-						//printf("v: %d i: %d\n", image[i_counter], i_counter);
-						n_size++;
-					}
+		if (input_args.view != VIEW_RAYMARCH || input_args.output_file != "none" || !input_args.normals_file.empty() ||
+				!input_args.mesh_file.empty() || input_args.repair >= 0 || input_args.morph_cpu || input_args.components) {
+			voxelizer.read_occupancy(image);
+			if (!input_args.morph.empty() && input_args.morph_cpu) {
+				{
+					profh::HostScope scope("morph");
+					volh::morph(image.data(), voxelResolution, input_args.morph);
+				}
+				voxelizer.write_occupancy(image);
+			}
+			if (input_args.repair >= 0) {
+				volh::RepairStats stats;
+				{
+					profh::HostScope scope("repair");
+					volh::repair(image.data(), voxelResolution, input_args.repair, &stats);
 				}
+				volh::print_repair_stats(stats);
+				voxelizer.write_occupancy(image);
 			}
+			if (input_args.components) {
+				std::vector<volh::Component> components;
+				std::vector<uint32_t> labels;
+				bool save = !input_args.component_labels_file.empty();
+				{
+					profh::HostScope scope("components");
+					volh::label_components(image.data(), voxelResolution, input_args.components, components, save ? &labels : NULL);
+				}
+				volh::print_components(components, input_args.components);
+				if (save && components.size() > 0xffff)
+					printf("Error: %zu components do not fit the 16-bit label file.\n", components.size());
+				else if (save)
+					gridh::save_labels(input_args.component_labels_file, voxelResolution, std::vector<uint16_t>(labels.begin(), labels.end()));
+			}
+			n_size = voxh::compact(image, voxelResolution, position);
+		}
+		if (input_args.output_file != "none")
+			voxh::save_file(input_args.output_file, input_args.dim, position);
+		if (input_args.view == VIEW_FACES) {
+			n_faces = voxh::exposed_faces(image.data(), voxelResolution, face);
+			std::cout << "n_faces: " << n_faces << std::endl;
+		}
+		if (!input_args.normals_file.empty()) {
+			voxelizer.read_normals(image, normal);
+			voxh::save_normals_file(input_args.normals_file, input_args.dim, position, normal);
+		}
+		if (!input_args.mesh_file.empty()) {
+			meshh::Mesh surface;
+			{
+				profh::HostScope scope(input_args.surface_nets ? "surface_nets" : "greedy_mesh");
+				if (input_args.surface_nets)
+					surfh::surface_nets(image.data(), voxelResolution, surface);
+				else
+					surfh::greedy_mesh(image.data(), voxelResolution, surface);
+			}
+			printf("mesh: n-verts %d n-faces %d\n", (int)surface.V.cols(), (int)surface.F.cols());
+			meshh::save_mesh(input_args.mesh_file, surface);
+		}
+		if (!input_args.labels_file.empty()) {
+			std::vector<uint16_t> labels;
+			voxelizer.read_labels(labels);
+			gridh::save_labels(input_args.labels_file, voxelResolution, labels);
 		}
-		save_file();
 		std::cout << "n_size: " << n_size << std::endl;
-    }
-    
-	void voxelize() {
-        glUseProgram(vao_voxelization.program);
-        glBindVertexArray(vao_voxelization.id_vao); 
-		
-        glBindBuffer(GL_ARRAY_BUFFER, vao_voxelization.id_vbo_position);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(0);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vao_voxelization.id_ebo);
-        glUniform3iv(glGetUniformLocation(vao_voxelization.program, "voxelResolution"), 1, voxelResolution);
-		
-		glDrawElements(GL_TRIANGLES, 3*mesh.F.cols(), GL_UNSIGNED_INT, 0);
-        
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		glDisableVertexAttribArray(0);
 
+		if (profh::get().is_enabled()) {
+			profh::get().resolve();
+			profh::get().write_report(stdout);
+			profh::get().write_chrome_trace(input_args.profile_file);
+		}
     }
 	
 	void draw() {
         glUseProgram(vao_render.program);
         glBindVertexArray(vao_render.id_vao); 
+
+		// once per frame rather than per vertex
+		Eigen::Matrix4f modelview_matrix = view_matrix*model_matrix;
+		Eigen::Matrix4f mvp_matrix = projection_matrix*modelview_matrix;
+		Eigen::Matrix3f normal_matrix = modelview_matrix.topLeftCorner<3, 3>().inverse().transpose();
+        glUniformMatrix4fv(glGetUniformLocation(vao_render.program, "modelview_matrix"), 1, GL_FALSE, modelview_matrix.data());
+        glUniformMatrix4fv(glGetUniformLocation(vao_render.program, "mvp_matrix"), 1, GL_FALSE, mvp_matrix.data());
+        glUniformMatrix3fv(glGetUniformLocation(vao_render.program, "normal_matrix"), 1, GL_FALSE, normal_matrix.data());
+        glUniformMatrix4fv(glGetUniformLocation(vao_render.program, "view_matrix"), 1, GL_FALSE, view_matrix.data());
+
+		if (input_args.view == VIEW_FACES) {
+			draw_faces();
+			return;
+		}
+		if (input_args.view == VIEW_RAYMARCH) {
+			draw_raymarch();
+			return;
+		}
 		
 		glVertexAttribDivisor(2, 1);
 
@@ -347,9 +364,6 @@ public:
 		float s = 0.45;
 		float scale[3] = {s/voxelResolution[0], s/voxelResolution[1], s/voxelResolution[2]};
         glUniform3fv(glGetUniformLocation(vao_render.program, "scale"), 1, scale);
-        glUniformMatrix4fv(glGetUniformLocation(vao_render.program, "model_matrix"), 1, GL_FALSE, model_matrix.data());
-        glUniformMatrix4fv(glGetUniformLocation(vao_render.program, "view_matrix"), 1, GL_FALSE, view_matrix.data());
-        glUniformMatrix4fv(glGetUniformLocation(vao_render.program, "projection_matrix"), 1, GL_FALSE, projection_matrix.data());
 		
 		glDrawArraysInstanced(GL_TRIANGLES, 0, 12*3, n_size);
         
@@ -359,7 +373,49 @@ public:
 		glDisableVertexAttribArray(2);
 	}
 
+	// one quad per exposed face, the cubes are full size so that the culled surface stays closed
+	void draw_faces() {
+		glBindBuffer(GL_ARRAY_BUFFER, vao_render.id_vbo_face);
+		glVertexAttribIPointer(0, 4, GL_UNSIGNED_SHORT, 0, 0);
+		glVertexAttribDivisor(0, 1);
+		glEnableVertexAttribArray(0);
+
+		float scale[3], voxel_size[3];
+		for (int i = 0; i < 3; i++) {
+			scale[i] = 0.5f/voxelResolution[i];
+			voxel_size[i] = 1.0f/voxelResolution[i];
+		}
+        glUniform3fv(glGetUniformLocation(vao_render.program, "scale"), 1, scale);
+        glUniform3fv(glGetUniformLocation(vao_render.program, "voxelSize"), 1, voxel_size);
+
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, n_faces);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDisableVertexAttribArray(0);
+	}
+
+	// one screen triangle, the fragment shader walks the grid; the cost follows the pixel count
+	void draw_raymarch() {
+		Eigen::Matrix4f inv_mvp_matrix = (projection_matrix*view_matrix*model_matrix).inverse();
+        glUniformMatrix4fv(glGetUniformLocation(vao_render.program, "inv_mvp_matrix"), 1, GL_FALSE, inv_mvp_matrix.data());
+        glUniform3iv(glGetUniformLocation(vao_render.program, "voxelResolution"), 1, voxelResolution);
+        glUniform1i(glGetUniformLocation(vao_render.program, "nLevels"), vao_render.n_mip_levels);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_3D, voxelizer.vao.id_image_occupany);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_3D, vao_render.id_image_mip);
+		glActiveTexture(GL_TEXTURE0);
+
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
 	
+	bool is_scene() const {
+		const std::string &in = input_args.input_file;
+		return in.size() > 6 && in.compare(in.size() - 6, 6, ".scene") == 0;
+	}
+
 	void update_camera() {
 		Eigen::Map<Eigen::Vector3f> eye(Camera::cam_position);
 		Eigen::Map<Eigen::Vector3f> up(Camera::cam_up);
@@ -372,34 +428,28 @@ public:
 		update_camera();
     }
 
-	void save_file() {
-		std::ofstream outFile(input_args.output_file, std::ios::out);
-		assert(outFile.is_open());
-		outFile << input_args.dim << std::endl;
-		outFile << n_size << std::endl;
-		for (int i = 0; i < n_size; i++) 
-			outFile << position[3*i + 0] << " " << position[3*i + 1] << " " << position[3*i + 2] << std::endl;
-		outFile.close();
-	}
-
 private:
 	Eigen::Matrix4f model_matrix;
 	Eigen::Matrix4f projection_matrix;
 	Eigen::Matrix4f view_matrix;
 
     RenderVAO vao_render;
-    VoxelizationVAO vao_voxelization;
+    voxh::Voxelizer voxelizer;
 	
 	int n_size;
+	int n_faces = 0;
+	std::vector<uint16_t> face;
 	std::vector<float> position;
+	std::vector<float> normal;
 	std::vector<float> color;
 	int voxelResolution[3];	
-	Mesh mesh;
+	meshh::Mesh mesh;
+	meshh::Scene scene;
 };
 
 void parse_args(int argc, char** argv) {
 	if (argc < 7) {
-		printf("Example Usage: ./main -dim 64 -in ./bunny.obj -out ./bunny.vox\n");
+		printf("Example Usage: ./main -dim 64 -in ./bunny.obj -out ./bunny.vox [-normals ./bunny.nrm] [-labels ./scene.voxl] [-mesh ./bunny_voxels.ply] [-surface greedy|nets] [-repair 2] [-morph close:cube:2,open:ball:1] [-morph_backend gl|cpu] [-components 6|18|26] [-component_labels ./parts.voxl] [-profile ./trace.json] [-thickness thin|fat] [-exact on|off] [-clean on|off] [-merge on|off] [-compress on|off] [-view cubes|faces|raymarch]\n");
 		std::exit(1);
 	}
 	assert(std::string(argv[1]) == "-dim");
@@ -408,11 +458,68 @@ void parse_args(int argc, char** argv) {
 	input_args.input_file = argv[4];
 	assert(std::string(argv[5]) == "-out");
 	input_args.output_file = argv[6];
+	for (int i = 7; i + 1 < argc; i += 2) {
+		if (std::string(argv[i]) == "-normals")
+			input_args.normals_file = argv[i + 1];
+		else if (std::string(argv[i]) == "-mesh")
+			input_args.mesh_file = argv[i + 1];
+		else if (std::string(argv[i]) == "-surface")
+			input_args.surface_nets = std::string(argv[i + 1]) == "nets";
+		else if (std::string(argv[i]) == "-repair")
+			input_args.repair = std::stoi(argv[i + 1]);
+		else if (std::string(argv[i]) == "-morph") {
+			if (!volh::parse_ops(argv[i + 1], input_args.morph)) {
+				printf("Error: bad morphology chain %s, expected op[:cube|cross|ball[:radius]],... with op dilate|erode|open|close\n", argv[i + 1]);
+				std::exit(1);
+			}
+		} else if (std::string(argv[i]) == "-morph_backend")
+			input_args.morph_cpu = std::string(argv[i + 1]) == "cpu";
+		else if (std::string(argv[i]) == "-components")
+			input_args.components = std::stoi(argv[i + 1]);
+		else if (std::string(argv[i]) == "-component_labels")
+			input_args.component_labels_file = argv[i + 1];
+		else if (std::string(argv[i]) == "-labels")
+			input_args.labels_file = argv[i + 1];
+		else if (std::string(argv[i]) == "-profile")
+			input_args.profile_file = argv[i + 1];
+		else if (std::string(argv[i]) == "-thickness")
+			input_args.thickness = std::string(argv[i + 1]) == "fat" ? cpuvoxh::FAT : cpuvoxh::THIN;
+		else if (std::string(argv[i]) == "-exact")
+			input_args.exact = std::string(argv[i + 1]) == "on";
+		else if (std::string(argv[i]) == "-clean")
+			input_args.clean = std::string(argv[i + 1]) == "on";
+		else if (std::string(argv[i]) == "-merge")
+			input_args.merge = std::string(argv[i + 1]) == "on";
+		else if (std::string(argv[i]) == "-compress")
+			input_args.compress = std::string(argv[i + 1]) == "on";
+		else if (std::string(argv[i]) == "-view")
+			input_args.view = std::string(argv[i + 1]) == "faces" ? VIEW_FACES
+				: std::string(argv[i + 1]) == "raymarch" ? VIEW_RAYMARCH : VIEW_CUBES;
+
+	}
+	// the integer-snapped voxelizer asserts on larger grids
+	if (input_args.exact && input_args.dim > cpuvoxh::EXACT_MAX_DIM) {
+		printf("Error: -exact on supports dims up to %d.\n", cpuvoxh::EXACT_MAX_DIM);
+		std::exit(1);
+	}
+	// voxels added by the repair or by morphology have no accumulated normal
+	if (!input_args.normals_file.empty() && (input_args.repair >= 0 || !input_args.morph.empty())) {
+		printf("Error: -normals cannot be combined with -repair or -morph.\n");
+		std::exit(1);
+	}
+	// nor an object label, and the label texture still holds the voxels they removed
+	if (!input_args.labels_file.empty() && (input_args.repair >= 0 || !input_args.morph.empty())) {
+		printf("Error: -labels cannot be combined with -repair or -morph.\n");
+		std::exit(1);
+	}
 };
 
 int main(int argc, char** argv) {
 	parse_args(argc, argv);
+	if (!input_args.profile_file.empty())
+		profh::get().enable();
 	GLFWwindow *window;
+
     oglh::init_gl("Voxelization", WINDOW_WIDTH, WINDOW_HEIGHT, &window);
 	glfwSetCursorPosCallback(window, Camera::mousemove_glfwCursorPosCallback);
 	glfwSetScrollCallback(window, Camera::mousemove_glfwScrollCallback);
@@ -0,0 +1,103 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#include <omp.h>
+
+#include "GridHelper.h"
+
+// Migrates text grids (.vox, as written by voxh::save_file) to binary grids (.voxb). Files are
+// converted in parallel, one per thread at a time; each is mapped and parsed with std::from_chars
+// (see gridh::parse_text). The output goes next to the input, or into -out_dir. Inputs are listed
+// on the command line and/or one per line in a -list file (for archives with millions of files).
+// Exits with 1 if any file fails.
+//
+// Example: ./voxconvert -out_dir binary/ old/*.vox
+//          find archive -name "*.vox" > files.txt && ./voxconvert -list files.txt -threads 16
+
+struct ConvertArgs {
+	std::vector<std::string> files;
+	std::string out_dir;
+	int threads = 0; // all OpenMP threads if 0
+} convert_args;
+
+static void parse_args(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string key = argv[i];
+		if ((key == "-out_dir" || key == "-list" || key == "-threads") && i + 1 < argc) {
+			std::string value = argv[++i];
+			if (key == "-out_dir") {
+				convert_args.out_dir = value;
+			} else if (key == "-threads") {
+				convert_args.threads = std::max(1, std::stoi(value));
+			} else {
+				std::ifstream list(value);
+				if (!list.is_open()) {
+					fprintf(stderr, "Error: Could not read %s.\n", value.c_str());
+					std::exit(1);
+				}
+				for (std::string line; std::getline(list, line);)
+					if (!line.empty())
+						convert_args.files.push_back(line);
+			}
+		} else if (key[0] != '-') {
+			convert_args.files.push_back(key);
+		} else {
+			convert_args.files.clear();
+			break;
+		}
+	}
+	if (convert_args.files.empty()) {
+		printf("Usage: ./voxconvert [-out_dir dir] [-list files.txt] [-threads n] a.vox b.vox ...\n");
+		std::exit(1);
+	}
+}
+
+// a/b/name.vox -> a/b/name.voxb, or out_dir/name.voxb
+static std::string output_name(const std::string &input) {
+	std::string name = input;
+	if (!convert_args.out_dir.empty()) {
+		size_t slash = name.find_last_of("/\\");
+		name = convert_args.out_dir + "/" + (slash == std::string::npos ? name : name.substr(slash + 1));
+	}
+	size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos && name.find_first_of("/\\", dot) == std::string::npos)
+		name.resize(dot);
+	return name + ".voxb";
+}
+
+int main(int argc, char** argv) {
+	parse_args(argc, argv);
+	if (convert_args.threads)
+		omp_set_num_threads(convert_args.threads);
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	size_t n_failed = 0, bytes_in = 0, n_voxels = 0;
+	#pragma omp parallel reduction(+: n_failed, bytes_in, n_voxels)
+	{
+		gridh::BitGrid grid;
+		gridh::MappedFile file;
+		#pragma omp for schedule(dynamic, 1)
+		for (int64_t i = 0; i < (int64_t)convert_args.files.size(); i++) {
+			const std::string &input = convert_args.files[i];
+			bool ok = file.open(input) && gridh::parse_text(file.data, file.data + file.size, grid, input) &&
+				gridh::save_binary(output_name(input), grid);
+			bytes_in += file.size;
+			file.close();
+			if (ok)
+				n_voxels += gridh::count(grid);
+			else
+				n_failed++;
+		}
+	}
+	double s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+
+	printf("converted %zu of %zu files, %zu voxels, %.1f MB of text in %.3f s (%.1f MB/s, %.0f files/s)\n",
+		convert_args.files.size() - n_failed, convert_args.files.size(), n_voxels, bytes_in*1e-6, s, bytes_in*1e-6/s,
+		convert_args.files.size()/s);
+	return n_failed ? 1 : 0;
+}
@@ -0,0 +1,495 @@
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <Eigen/Dense>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "OpenGLHelper.h"
+#include "MeshHelper.h"
+#include "VoxelHelper.h"
+#include "CPUVoxelHelper.h"
+#include "GridHelper.h"
+
+// Long-running voxelizer. The GL context, the compiled programs and the grid textures stay alive
+// between jobs, so a job only pays for load, upload, voxelize, readback and save.
+//
+// Jobs are read line by line from stdin (default) or from clients of a local Unix socket (-socket path):
+//
+//     <mesh> <dim> <out> [thin|fat] [normals <path>]
+//
+// <mesh> is a .obj/.ply path or inline:<n_verts>:<n_faces>, in which case the line is followed by
+// n_verts*3 float32 positions and n_faces*3 uint32 indices (little-endian). <out> is a .vox path or
+// "-" to get the bit-packed grid back inline. Every job is answered in order with one of
+//
+//     ok <n_voxels> <ms>
+//     grid <dim> <n_voxels> <n_bytes>\n<n_bytes of uint64 words, see GridHelper.h>
+//     error <message>
+//
+// A malformed inline header (or a payload cut short, or counts above MAX_INLINE_ELEMENTS) is answered
+// with an error and ends the connection (stdin: the server), since the following bytes can no longer
+// be told apart from requests.
+// A client that goes away early only drops its own connection, its remaining answers are discarded.
+//
+// Jobs are pipelined over three threads: a reader that parses and loads/normalizes the next mesh,
+// the GL thread and a writer that compacts, saves and answers. The occupancy grid is read back
+// asynchronously into a ring of persistently mapped PBOs (voxh::ReadbackRing), so the upload and
+// voxelization of job N+1 are queued before the GL thread waits for the fence of job N, and the
+// writer compacts job N straight out of the mapped buffer while the GPU works on job N+1.
+//
+// With -exact on, all jobs use the integer-snapped voxelizer (see cpuvoxh::voxelize_triangle_exact).
+// With -clean on, every mesh is welded and stripped of degenerate and duplicate faces while it is
+// normalized (see meshh::normalize_clean_mesh).
+// With -merge on, triangles within a single voxel are written as points (see cpuvoxh::split_subvoxel).
+// With -compress on, meshes are uploaded with 16-bit positions and meshlet indices (see voxh::Voxelizer).
+//
+// Example: ./voxel_server -socket /tmp/voxelizer.sock
+//          echo "../resources/bunny.obj 64 bunny.vox" | ./voxel_server
+
+struct ServerArgs {
+	std::string socket_path;
+	bool exact = false;
+	bool clean = false;
+	bool merge = false;
+	bool compress = false;
+	int stdout_fd = STDOUT_FILENO; // responses in stdin mode, logging goes to stderr
+} server_args;
+
+// output end of a client; closed once the reader and all pending jobs are done with it
+struct Connection {
+	int fd;
+	bool owned;
+	std::atomic<bool> broken{false}; // the client is gone (EPIPE), nothing more is sent or read
+	Connection(int fd, bool owned) : fd(fd), owned(owned) {}
+	~Connection() {
+		if (owned)
+			close(fd);
+	}
+	void send(const void *data, size_t n) {
+		const char *p = (const char*)data;
+		while (n > 0 && !broken) {
+			// sockets are written without SIGPIPE, stdout relies on SIGPIPE being ignored in main
+			ssize_t k = owned ? ::send(fd, p, n, MSG_NOSIGNAL) : write(fd, p, n);
+			if (k < 0 && errno == EINTR)
+				continue;
+			if (k <= 0) {
+				// wakes the reader of a socket client, which then drops the connection
+				broken = true;
+				if (owned)
+					shutdown(fd, SHUT_RDWR);
+				return;
+			}
+			p += k;
+			n -= k;
+		}
+	}
+	void send_line(const std::string &line) {
+		std::string s = line + "\n";
+		send(s.data(), s.size());
+	}
+};
+
+struct Job {
+	std::shared_ptr<Connection> connection;
+	std::string error;
+	meshh::Mesh mesh;
+	int dim = 0;
+	std::string output_file;
+	std::string normals_file;
+	cpuvoxh::Thickness thickness = cpuvoxh::THIN;
+	std::chrono::steady_clock::time_point t_start;
+	std::vector<uint8_t> image;   // only used for jobs with normals (blocking readback)
+	const uint8_t *readback = NULL; // mapped ReadbackRing slot
+	int readback_slot = -1;
+	std::vector<float> normal;
+
+	bool quit = false;
+	bool desync = false; // the payload could not be consumed, the rest of the stream is unreadable
+};
+
+template<typename T>
+class BlockingQueue {
+public:
+	void push(T item) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			items.push_back(std::move(item));
+		}
+		cv.notify_one();
+	}
+
+	T pop() {
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this] { return !items.empty(); });
+		T item = std::move(items.front());
+		items.pop_front();
+		return item;
+	}
+
+	bool try_pop(T &item) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (items.empty())
+			return false;
+		item = std::move(items.front());
+		items.pop_front();
+		return true;
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<T> items;
+};
+
+typedef std::unique_ptr<Job> JobPtr;
+
+// buffered reader over a file descriptor, supports mixing text lines and raw binary payloads
+class FdReader {
+public:
+	FdReader(int fd) : fd(fd) {}
+
+	bool read_line(std::string &line) {
+		line.clear();
+		while (true) {
+			for (; pos < end; pos++) {
+				if (buffer[pos] == '\n') {
+					pos++;
+					return true;
+				}
+				line += buffer[pos];
+			}
+			if (!fill())
+				return !line.empty();
+		}
+	}
+
+	bool read_bytes(void *dst, size_t n) {
+		char *p = (char*)dst;
+		while (n > 0) {
+			if (pos == end && !fill())
+				return false;
+			size_t k = std::min(n, end - pos);
+			std::memcpy(p, buffer + pos, k);
+			pos += k;
+			p += k;
+			n -= k;
+		}
+		return true;
+	}
+
+	bool skip_bytes(size_t n) {
+		while (n > 0) {
+			if (pos == end && !fill())
+				return false;
+			size_t k = std::min(n, end - pos);
+			pos += k;
+			n -= k;
+		}
+		return true;
+	}
+
+private:
+	bool fill() {
+		ssize_t k = read(fd, buffer, sizeof(buffer));
+		pos = 0;
+		end = k > 0 ? k : 0;
+		return k > 0;
+	}
+
+	int fd;
+	char buffer[1 << 16];
+	size_t pos = 0, end = 0;
+};
+
+// inline meshes above this many vertices or faces are refused before anything is allocated for them
+static const int MAX_INLINE_ELEMENTS = 1 << 26;
+
+// parses one request line (and its inline payload) and loads the mesh, errors are reported through job->error
+static JobPtr read_job(FdReader &reader, const std::string &line, std::shared_ptr<Connection> connection) {
+	JobPtr job(new Job);
+	job->connection = connection;
+	job->t_start = std::chrono::steady_clock::now();
+
+	std::stringstream ss(line);
+	std::string mesh_spec, token;
+	ss >> mesh_spec >> job->dim >> job->output_file;
+	if (mesh_spec == "quit") {
+		job->quit = true;
+		return job;
+	}
+	while (ss >> token) {
+		if (token == "fat")
+			job->thickness = cpuvoxh::FAT;
+		else if (token == "thin")
+			job->thickness = cpuvoxh::THIN;
+		else if (token == "normals")
+			ss >> job->normals_file;
+	}
+
+	if (mesh_spec.compare(0, 7, "inline:") == 0) {
+		int n_verts = 0, n_faces = 0;
+		if (sscanf(mesh_spec.c_str(), "inline:%d:%d", &n_verts, &n_faces) != 2 || n_verts < 0 || n_faces < 0) {
+			// the payload size is unknown, so the request boundaries are lost
+			job->error = "bad inline mesh header, closing the connection";
+			job->desync = true;
+			return job;
+		}
+		if (n_verts > MAX_INLINE_ELEMENTS || n_faces > MAX_INLINE_ELEMENTS) {
+			// skipping a payload that size would most likely swallow the following requests
+			job->error = "inline mesh above " + std::to_string(MAX_INLINE_ELEMENTS) + " vertices or faces, closing the connection";
+			job->desync = true;
+			return job;
+		}
+		const size_t n_bytes_v = 3*(size_t)n_verts*sizeof(float), n_bytes_f = 3*(size_t)n_faces*sizeof(uint32_t);
+		if (n_verts == 0 || n_faces == 0) {
+			job->error = "empty inline mesh";
+			job->desync = !reader.skip_bytes(n_bytes_v + n_bytes_f);
+			return job;
+		}
+		try {
+			job->mesh.V.resize(3, n_verts);
+			job->mesh.F.resize(3, n_faces);
+		} catch (const std::bad_alloc &) {
+			job->error = "out of memory for the inline mesh, closing the connection";
+			job->desync = true;
+			return job;
+		}
+		if (!reader.read_bytes(job->mesh.V.data(), n_bytes_v) || !reader.read_bytes(job->mesh.F.data(), n_bytes_f)) {
+			job->error = "truncated inline mesh";
+			job->desync = true;
+			return job;
+		}
+		if (job->mesh.F.maxCoeff() >= (uint32_t)n_verts) {
+			job->error = "inline mesh index out of range";
+			return job;
+		}
+	} else if (!meshh::try_load_mesh(mesh_spec, job->mesh)) {
+		// also rejects empty meshes and out-of-range indices, like the inline checks above
+		job->error = "cannot read mesh " + mesh_spec;
+		return job;
+	}
+
+	if (job->dim <= 0 || job->output_file.empty()) {
+		job->error = "expected: <mesh> <dim> <out> [thin|fat] [normals <path>]";
+		return job;
+	}
+	if (server_args.exact && job->dim > cpuvoxh::EXACT_MAX_DIM) {
+		// the integer-snapped voxelizer asserts on larger grids
+		job->error = "dim above " + std::to_string(cpuvoxh::EXACT_MAX_DIM) + " with -exact on";
+		return job;
+	}
+	if (server_args.clean) {
+		meshh::CleanStats stats;
+		meshh::normalize_clean_mesh(job->mesh, stats);
+		meshh::print_clean_stats(stats);
+	} else {
+		meshh::normalize_mesh(job->mesh);
+	}
+	return job;
+}
+
+static void reader_thread(BlockingQueue<JobPtr> &loaded) {
+	auto serve = [&](int fd_in, std::shared_ptr<Connection> connection) {
+		FdReader reader(fd_in);
+		std::string line;
+		while (!connection->broken && reader.read_line(line)) {
+			if (line.empty())
+				continue;
+			JobPtr job = read_job(reader, line, connection);
+			bool quit = job->quit, desync = job->desync;
+			loaded.push(std::move(job));
+			if (quit)
+				return true;
+			// the error is still answered, then the connection closes with its last job
+			if (desync)
+				return false;
+		}
+		return false;
+	};
+
+	if (server_args.socket_path.empty()) {
+		serve(STDIN_FILENO, std::make_shared<Connection>(server_args.stdout_fd, false));
+	} else {
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		std::strncpy(addr.sun_path, server_args.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+		unlink(server_args.socket_path.c_str());
+		if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+			fprintf(stderr, "Error: Could not listen on %s.\n", server_args.socket_path.c_str());
+		} else {
+			fprintf(stderr, "listening on %s\n", server_args.socket_path.c_str());
+			while (true) {
+				int client = accept(fd, NULL, NULL);
+				if (client < 0)
+					continue;
+				if (serve(client, std::make_shared<Connection>(client, true)))
+					break;
+			}
+		}
+		if (fd >= 0)
+			close(fd);
+		unlink(server_args.socket_path.c_str());
+	}
+
+	JobPtr job(new Job);
+	job->quit = true;
+	loaded.push(std::move(job));
+}
+
+static void writer_thread(BlockingQueue<JobPtr> &done, voxh::ReadbackRing &ring) {
+	while (true) {
+		JobPtr job = done.pop();
+		if (job->quit)
+			return;
+		if (!job->error.empty()) {
+			job->connection->send_line("error " + job->error);
+			continue;
+		}
+
+		int resolution[3] = {job->dim, job->dim, job->dim};
+		const uint8_t *image = job->readback ? job->readback : job->image.data();
+		std::vector<float> position;
+		int n_size = voxh::compact(image, resolution, position);
+		if (!job->normals_file.empty())
+			voxh::save_normals_file(job->normals_file, job->dim, position, job->normal);
+
+		if (job->output_file == "-") {
+			gridh::BitGrid grid;
+			gridh::pack(image, resolution, grid);
+			if (job->readback)
+				ring.release(job->readback_slot);
+			size_t n_bytes = grid.words.size()*sizeof(uint64_t);
+			job->connection->send_line("grid " + std::to_string(job->dim) + " " + std::to_string(n_size) + " " + std::to_string(n_bytes));
+			job->connection->send(grid.words.data(), n_bytes);
+		} else {
+			if (job->readback)
+				ring.release(job->readback_slot);
+			voxh::save_file(job->output_file, job->dim, position);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job->t_start).count();
+			char msg[64];
+			snprintf(msg, sizeof(msg), "ok %d %.3f", n_size, ms);
+			job->connection->send_line(msg);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (std::string(argv[i]) == "-socket") {
+			server_args.socket_path = argv[i + 1];
+		} else if (std::string(argv[i]) == "-exact") {
+			server_args.exact = std::string(argv[i + 1]) == "on";
+		} else if (std::string(argv[i]) == "-clean") {
+			server_args.clean = std::string(argv[i + 1]) == "on";
+		} else if (std::string(argv[i]) == "-merge") {
+			server_args.merge = std::string(argv[i + 1]) == "on";
+		} else if (std::string(argv[i]) == "-compress") {
+			server_args.compress = std::string(argv[i + 1]) == "on";
+		} else {
+			printf("Example Usage: ./voxel_server [-socket /tmp/voxelizer.sock] [-exact on|off] [-clean on|off] [-merge on|off] [-compress on|off]\n");
+
+			std::exit(1);
+		}
+	}
+
+	// a client that disconnects must not take the server down, failed writes end its connection instead
+	signal(SIGPIPE, SIG_IGN);
+
+	// keep stdout for responses only, everything printed by the helpers goes to stderr instead
+	server_args.stdout_fd = dup(STDOUT_FILENO);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+
+	GLFWwindow *window;
+	oglh::init_gl("voxel_server", 64, 64, &window, false);
+
+	// one voxelizer per thickness, created on first use
+	voxh::Voxelizer voxelizers[2];
+	bool ready[2] = {false, false};
+	// one slot in flight on the GPU, one being compacted by the writer, one spare
+	voxh::ReadbackRing ring;
+	ring.init(3);
+
+	BlockingQueue<JobPtr> loaded, done;
+	std::thread reader(reader_thread, std::ref(loaded));
+	std::thread writer(writer_thread, std::ref(done), std::ref(ring));
+
+	JobPtr in_flight;
+	auto finish_in_flight = [&]() {
+		if (!in_flight)
+			return;
+		in_flight->readback = ring.wait(in_flight->readback_slot);
+		done.push(std::move(in_flight));
+	};
+
+	while (true) {
+		JobPtr job;
+		if (!in_flight) {
+			job = loaded.pop();
+		} else if (!loaded.try_pop(job)) {
+			// nothing to overlap with, hand the grid over right away instead of waiting for the next job
+			finish_in_flight();
+			continue;
+		}
+
+		if (job->quit) {
+			finish_in_flight();
+			done.push(std::move(job));
+			break;
+		}
+		if (!job->error.empty()) {
+			finish_in_flight();
+			done.push(std::move(job));
+			continue;
+		}
+
+		int t = job->thickness;
+		voxh::Voxelizer &voxelizer = voxelizers[t];
+		if (!ready[t]) {
+			voxelizer.init(job->thickness, server_args.exact, server_args.merge, server_args.compress);
+			ready[t] = true;
+		}
+		int resolution[3] = {job->dim, job->dim, job->dim};
+		voxelizer.upload_mesh(job->mesh);
+		voxelizer.init_grid(resolution, !job->normals_file.empty());
+		voxelizer.voxelize();
+
+		if (!job->normals_file.empty()) {
+			// the normal grids are cleared by the next job, so these are read back synchronously
+			finish_in_flight();
+			voxelizer.read_occupancy(job->image);
+			voxelizer.read_normals(job->image, job->normal);
+			done.push(std::move(job));
+			continue;
+		}
+
+		// queue the download of job N+1 behind its draw, then wait for job N
+		job->readback_slot = ring.begin(voxelizer);
+		finish_in_flight();
+		in_flight = std::move(job);
+	}
+
+	reader.join();
+	writer.join();
+	ring.term();
+	for (int t = 0; t < 2; t++)
+		if (ready[t])
+			voxelizers[t].term();
+	oglh::terminate_window();
+	return 0;
+}
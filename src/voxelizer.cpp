@@ -0,0 +1,289 @@
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "OpenGLHelper.h"
+#include "MeshHelper.h"
+#include "VoxelHelper.h"
+#include "CPUVoxelHelper.h"
+#include "GridHelper.h"
+#include "voxelizer.h"
+
+// Library behind voxelizer.h. The context keeps the normalized mesh, the last grid's size and, once
+// it was needed, the grid bit-packed (gridh::BitGrid order), from which the counts and coordinates
+// are taken. Dense and bitset reads are written straight into the caller's buffer: by the texture
+// download or the GPU pack of voxh::Voxelizer, or by the CPU voxelizer itself.
+
+struct VoxContext {
+	VoxBackend backend;
+	cpuvoxh::Thickness thickness;
+	bool exact;
+	std::string error;
+
+	GLFWwindow *window = NULL;
+	voxh::Voxelizer voxelizer;
+	bool uploaded = false; // the mesh is on the GPU
+
+	meshh::Mesh mesh;
+	int dim[3] = {0, 0, 0};
+	bool voxelized = false;
+	std::vector<uint64_t> words; // the grid bit-packed, if bits_valid
+	bool bits_valid = false;
+	size_t n_voxels = 0;
+	std::vector<uint8_t> image; // CPU backend, dense grid for bitset and coordinate reads
+
+	size_t size() const {
+		return (size_t)dim[0]*dim[1]*dim[2];
+	}
+
+	size_t n_words() const {
+		return (size() + 63)/64;
+	}
+};
+
+static int n_windows = 0; // GLFW is terminated with the last GL context
+
+static int fail(VoxContext *ctx, const std::string &message) {
+	ctx->error = message;
+	return -1;
+}
+
+static void make_current(VoxContext *ctx) {
+	if (ctx->window && glfwGetCurrentContext() != ctx->window)
+		glfwMakeContextCurrent(ctx->window);
+}
+
+static void voxelize_cpu(VoxContext *ctx, uint8_t *image) {
+	std::memset(image, 0, ctx->size());
+	cpuvoxh::voxelize_faces(ctx->mesh, ctx->mesh.F.data(), ctx->mesh.F.cols(), ctx->dim, ctx->thickness, image, ctx->exact);
+}
+
+// the grid bit-packed in ctx->words, read back or voxelized once per grid
+static void ensure_bits(VoxContext *ctx) {
+	if (ctx->bits_valid)
+		return;
+	ctx->words.resize(ctx->n_words());
+	if (ctx->backend == VOX_BACKEND_GL) {
+		make_current(ctx);
+		ctx->voxelizer.read_bits(ctx->words.data());
+	} else {
+		ctx->image.resize(ctx->size());
+		voxelize_cpu(ctx, ctx->image.data());
+		gridh::pack_words(ctx->image.data(), ctx->size(), ctx->words.data());
+	}
+	ctx->n_voxels = gridh::count_words(ctx->words.data(), ctx->words.size());
+	ctx->bits_valid = true;
+}
+
+static int64_t required_bytes(VoxContext *ctx, VoxLayout layout) {
+	if (layout == VOX_DENSE)
+		return ctx->size();
+	if (layout == VOX_BITSET)
+		return ctx->n_words()*sizeof(uint64_t);
+	ensure_bits(ctx);
+	return ctx->n_voxels*3*sizeof(uint16_t);
+}
+
+static void describe(VoxGrid *grid, VoxLayout layout, void *buffer, const VoxContext *ctx, int64_t n_bytes) {
+	std::memset(grid, 0, sizeof(VoxGrid));
+	grid->layout = layout;
+	for (int i = 0; i < 3; i++)
+		grid->dim[i] = ctx->dim[i];
+	grid->n_voxels = ctx->n_voxels;
+	grid->n_bytes = n_bytes;
+
+	VoxDLTensor &t = grid->tensor;
+	t.data = buffer;
+	t.device.device_type = 1; // kDLCPU
+	t.dtype.code = 1; // kDLUInt
+	t.dtype.lanes = 1;
+	t.shape = grid->shape;
+	t.strides = grid->strides;
+	if (layout == VOX_DENSE) {
+		t.ndim = 3;
+		t.dtype.bits = 8;
+		grid->shape[0] = ctx->dim[2];
+		grid->shape[1] = ctx->dim[1];
+		grid->shape[2] = ctx->dim[0];
+		grid->strides[0] = (int64_t)ctx->dim[0]*ctx->dim[1];
+		grid->strides[1] = ctx->dim[0];
+		grid->strides[2] = 1;
+	} else if (layout == VOX_BITSET) {
+		t.ndim = 1;
+		t.dtype.bits = 64;
+		grid->shape[0] = ctx->n_words();
+		grid->strides[0] = 1;
+	} else {
+		t.ndim = 2;
+		t.dtype.bits = 16;
+		grid->shape[0] = ctx->n_voxels;
+		grid->shape[1] = 3;
+		grid->strides[0] = 3;
+		grid->strides[1] = 1;
+	}
+}
+
+// Validates and normalizes mesh, then makes it the context's mesh. A rejected mesh leaves the
+// previous one in place; the previous grid is dropped either way.
+static int replace_mesh(VoxContext *ctx, meshh::Mesh &mesh, bool clean) {
+	ctx->voxelized = false;
+	ctx->bits_valid = false;
+	if (mesh.V.cols() == 0 || mesh.F.cols() == 0)
+		return fail(ctx, "empty mesh");
+	if (mesh.F.maxCoeff() >= (uint32_t)mesh.V.cols())
+		return fail(ctx, "mesh index out of range");
+	if (clean) {
+		meshh::CleanStats stats;
+		meshh::normalize_clean_mesh(mesh, stats);
+	} else {
+		meshh::normalize_mesh(mesh);
+	}
+	std::swap(ctx->mesh, mesh);
+	ctx->uploaded = false;
+	ctx->error.clear();
+	return 0;
+}
+
+extern "C" {
+
+VoxContext *vox_create(VoxBackend backend, VoxThickness thickness, int exact) {
+	VoxContext *ctx = new VoxContext;
+	ctx->backend = backend;
+	ctx->thickness = thickness == VOX_FAT ? cpuvoxh::FAT : cpuvoxh::THIN;
+	ctx->exact = exact != 0;
+	if (backend != VOX_BACKEND_GL)
+		return ctx;
+	try {
+		oglh::init_gl("voxelizer", 64, 64, &ctx->window, false);
+		n_windows++;
+		ctx->voxelizer.init(ctx->thickness, ctx->exact);
+	} catch (const std::exception &e) {
+		fprintf(stderr, "Error: %s\n", e.what());
+		vox_destroy(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+void vox_destroy(VoxContext *ctx) {
+	if (!ctx)
+		return;
+	if (ctx->window) {
+		make_current(ctx);
+		if (ctx->voxelizer.vao.program)
+			ctx->voxelizer.term();
+		glfwDestroyWindow(ctx->window);
+		if (--n_windows == 0)
+			glfwTerminate();
+	}
+	delete ctx;
+}
+
+const char *vox_error(const VoxContext *ctx) {
+	return ctx ? ctx->error.c_str() : "no context";
+}
+
+int vox_load_mesh(VoxContext *ctx, const char *filename, int clean) {
+	std::string name = filename ? filename : "";
+	meshh::Mesh mesh;
+	if (!meshh::try_load_mesh(name, mesh)) {
+		ctx->voxelized = false;
+		ctx->bits_valid = false;
+		return fail(ctx, "cannot read mesh " + name);
+	}
+	return replace_mesh(ctx, mesh, clean != 0);
+}
+
+int vox_set_mesh(VoxContext *ctx, const float *positions, int64_t n_vertices, const uint32_t *faces, int64_t n_faces, int clean) {
+	if (n_vertices <= 0 || n_faces <= 0 || !positions || !faces) {
+		ctx->voxelized = false;
+		ctx->bits_valid = false;
+		return fail(ctx, "invalid mesh arrays");
+	}
+	meshh::Mesh mesh;
+	mesh.V = Eigen::Map<const Eigen::Matrix<float, -1, -1>>(positions, 3, n_vertices);
+	mesh.F = Eigen::Map<const Eigen::Matrix<uint32_t, -1, -1>>(faces, 3, n_faces);
+	return replace_mesh(ctx, mesh, clean != 0);
+}
+
+int vox_voxelize(VoxContext *ctx, const int32_t dim[3]) {
+	// a failed call drops the previous grid, its size no longer matches ctx->dim
+	ctx->voxelized = false;
+	ctx->bits_valid = false;
+	if (ctx->mesh.F.cols() == 0)
+		return fail(ctx, "no mesh");
+	for (int i = 0; i < 3; i++)
+		if (dim[i] <= 0 || (ctx->exact && dim[i] > cpuvoxh::EXACT_MAX_DIM))
+			return fail(ctx, "invalid grid size");
+	for (int i = 0; i < 3; i++)
+		ctx->dim[i] = dim[i];
+	if (ctx->backend == VOX_BACKEND_GL) {
+		make_current(ctx);
+		if (!ctx->uploaded)
+			ctx->voxelizer.upload_mesh(ctx->mesh);
+		ctx->uploaded = true;
+		ctx->voxelizer.init_grid(ctx->dim, false);
+		ctx->voxelizer.voxelize();
+	}
+	// the CPU backend voxelizes on the first read, into the caller's buffer if it is dense
+	ctx->voxelized = true;
+	ctx->error.clear();
+	return 0;
+}
+
+int64_t vox_required_bytes(VoxContext *ctx, VoxLayout layout) {
+	if (!ctx->voxelized)
+		return fail(ctx, "nothing voxelized");
+	return required_bytes(ctx, layout);
+}
+
+int vox_read(VoxContext *ctx, VoxLayout layout, void *buffer, int64_t capacity, VoxGrid *grid) {
+	if (!ctx->voxelized)
+		return fail(ctx, "nothing voxelized");
+	if (layout == VOX_COORDS && *std::max_element(ctx->dim, ctx->dim + 3) > 65536)
+		return fail(ctx, "grid too large for uint16 coordinates");
+	int64_t n_bytes = required_bytes(ctx, layout);
+	if (!buffer || !grid || capacity < n_bytes)
+		return fail(ctx, "buffer too small, " + std::to_string(n_bytes) + " bytes needed");
+
+	if (layout == VOX_DENSE) {
+		uint8_t *image = (uint8_t*)buffer;
+		if (ctx->bits_valid) {
+			gridh::unpack_words(ctx->words.data(), ctx->size(), image);
+		} else {
+			if (ctx->backend == VOX_BACKEND_GL) {
+				make_current(ctx);
+				ctx->voxelizer.read_occupancy(image);
+			} else {
+				voxelize_cpu(ctx, image);
+			}
+			// one pass for the voxel count, which also serves later reads of the same grid
+			ctx->words.resize(ctx->n_words());
+			gridh::pack_words(image, ctx->size(), ctx->words.data());
+			ctx->n_voxels = gridh::count_words(ctx->words.data(), ctx->words.size());
+			ctx->bits_valid = true;
+		}
+	} else if (layout == VOX_BITSET) {
+		uint64_t *words = (uint64_t*)buffer;
+		if (ctx->bits_valid) {
+			std::memcpy(words, ctx->words.data(), n_bytes);
+		} else if (ctx->backend == VOX_BACKEND_GL) {
+			make_current(ctx);
+			ctx->voxelizer.read_bits(words);
+			ctx->n_voxels = gridh::count_words(words, ctx->n_words());
+		} else {
+			ensure_bits(ctx);
+			std::memcpy(words, ctx->words.data(), n_bytes);
+		}
+	} else {
+		gridh::to_coords(ctx->words.data(), ctx->dim, (uint16_t*)buffer);
+	}
+	describe(grid, layout, buffer, ctx, n_bytes);
+	ctx->error.clear();
+	return 0;
+}
+
+}
@@ -0,0 +1,119 @@
+#ifndef VOXELIZER_H
+#define VOXELIZER_H
+
+#include <stdint.h>
+
+// C interface of the voxelizer library (target voxelizer) for data loaders and other languages.
+// Grids are written into memory owned by the caller, in one of three layouts, and described by a
+// DLPack tensor (DLTensor layout, CPU device), so they can be wrapped without copies, e.g. as a
+// NumPy array (see voxelizer_py.cpp) or passed to any framework that takes DLPack.
+//
+//   VoxContext *ctx = vox_create(VOX_BACKEND_GL, VOX_THIN, 0);
+//   vox_load_mesh(ctx, "bunny.obj", 0);
+//   int32_t dim[3] = {128, 128, 128};
+//   vox_voxelize(ctx, dim);
+//   int64_t n = vox_required_bytes(ctx, VOX_BITSET);
+//   VoxGrid grid;
+//   vox_read(ctx, VOX_BITSET, buffer, n, &grid);
+//
+// Functions returning int give 0 on success and -1 on failure, see vox_error(). A context must be
+// used by one thread at a time; the GL backend owns a hidden window and makes its context current
+// on every call.
+
+#if defined(_WIN32)
+#ifdef VOXELIZER_BUILD
+#define VOX_API __declspec(dllexport)
+#else
+#define VOX_API __declspec(dllimport)
+#endif
+#else
+#define VOX_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { VOX_BACKEND_GL = 0, VOX_BACKEND_CPU = 1 } VoxBackend;
+typedef enum { VOX_THIN = 0, VOX_FAT = 1 } VoxThickness; // as cpuvoxh::Thickness
+
+typedef enum {
+	VOX_DENSE = 0,  // uint8 [dimz][dimy][dimx], 1 where occupied
+	VOX_BITSET = 1, // uint64 [(dimx*dimy*dimz + 63)/64], voxel x + y*dimx + z*dimx*dimy is bit i % 64 of word i / 64 (.voxb)
+	VOX_COORDS = 2  // uint16 [n_voxels][3], x, y, z of the occupied voxels in grid order
+} VoxLayout;
+
+// Layout-compatible with DLDevice, DLDataType, DLTensor and DLManagedTensor of dlpack.h (v0.6 and
+// later), so the structs can be cast to the DLPack ones without including it.
+typedef struct {
+	int32_t device_type; // kDLCPU = 1
+	int32_t device_id;
+} VoxDLDevice;
+
+typedef struct {
+	uint8_t code; // kDLUInt = 1
+	uint8_t bits;
+	uint16_t lanes;
+} VoxDLDataType;
+
+typedef struct {
+	void *data;
+	VoxDLDevice device;
+	int32_t ndim;
+	VoxDLDataType dtype;
+	int64_t *shape;
+	int64_t *strides; // in elements, row-major
+	uint64_t byte_offset;
+} VoxDLTensor;
+
+typedef struct VoxDLManagedTensor {
+	VoxDLTensor dl_tensor;
+	void *manager_ctx;
+	void (*deleter)(struct VoxDLManagedTensor *self);
+} VoxDLManagedTensor;
+
+// A grid in caller memory. tensor.shape and tensor.strides point into the struct itself, so it must
+// stay in place while the tensor is in use (copy the arrays along when moving it).
+typedef struct {
+	VoxDLTensor tensor;
+	int64_t shape[3];
+	int64_t strides[3];
+	int32_t layout; // VoxLayout
+	int32_t dim[3];
+	int64_t n_voxels; // occupied
+	int64_t n_bytes; // written to the buffer
+} VoxGrid;
+
+typedef struct VoxContext VoxContext;
+
+// NULL if the backend cannot be set up (reason on stderr). exact: integer-snapped triangle tests,
+// the same grid on both backends (see -exact in the README).
+VOX_API VoxContext *vox_create(VoxBackend backend, VoxThickness thickness, int exact);
+VOX_API void vox_destroy(VoxContext *ctx);
+
+// message of the last failed call, "" if none
+VOX_API const char *vox_error(const VoxContext *ctx);
+
+// .obj or .ply, normalized to the unit cube like in main; clean: see -clean in the README
+VOX_API int vox_load_mesh(VoxContext *ctx, const char *filename, int clean);
+// n_vertices float xyz triples and n_faces uint32 index triples, copied and normalized
+VOX_API int vox_set_mesh(VoxContext *ctx, const float *positions, int64_t n_vertices, const uint32_t *faces, int64_t n_faces,
+	int clean);
+
+// voxelizes the current mesh into a dimx x dimy x dimz grid kept by the context until the next call
+VOX_API int vox_voxelize(VoxContext *ctx, const int32_t dim[3]);
+
+// size of the buffer vox_read() needs for the last grid, -1 on failure. For VOX_COORDS this counts
+// the voxels (GL backend: reads the grid back bit-packed), which a following vox_read() reuses.
+VOX_API int64_t vox_required_bytes(VoxContext *ctx, VoxLayout layout);
+
+// Writes the last grid into buffer (capacity bytes, suitably aligned for the element type) and
+// describes it in grid. The GL backend downloads dense grids straight into the buffer and packs
+// bitsets on the GPU, 1/8 of the transfer; coordinates are expanded from the bits.
+VOX_API int vox_read(VoxContext *ctx, VoxLayout layout, void *buffer, int64_t capacity, VoxGrid *grid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
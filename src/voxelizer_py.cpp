@@ -0,0 +1,144 @@
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+
+#include "voxelizer.h"
+
+// Python module over the voxelizer library (built when pybind11 is found). Grids are written by
+// vox_read() straight into NumPy arrays, allocated here or passed in with out= to reuse a loader's
+// buffers; NumPy >= 1.22 exports them through DLPack, e.g. torch.from_dlpack(grid).
+//
+//   import pyvoxelizer
+//   v = pyvoxelizer.Voxelizer(backend="gl", thickness="thin")
+//   v.load_mesh("bunny.obj")
+//   v.voxelize(128)
+//   grid = v.read("dense")      # uint8 [z, y, x]
+//   bits = v.read("bitset")     # uint64 [(x*y*z + 63)/64], the .voxb words
+//   xyz = v.read("coords")      # uint16 [n, 3]
+
+namespace py = pybind11;
+
+static VoxLayout parse_layout(const std::string &name) {
+	if (name == "dense")
+		return VOX_DENSE;
+	if (name == "bitset")
+		return VOX_BITSET;
+	if (name == "coords")
+		return VOX_COORDS;
+	throw py::value_error("layout must be dense, bitset or coords");
+}
+
+class PyVoxelizer {
+public:
+	PyVoxelizer(const std::string &backend, const std::string &thickness, bool exact) {
+		if ((backend != "gl" && backend != "cpu") || (thickness != "thin" && thickness != "fat"))
+			throw py::value_error("backend must be gl or cpu, thickness thin or fat");
+		ctx = vox_create(backend == "gl" ? VOX_BACKEND_GL : VOX_BACKEND_CPU, thickness == "fat" ? VOX_FAT : VOX_THIN, exact);
+		if (!ctx)
+			throw std::runtime_error("cannot create the " + backend + " voxelizer");
+	}
+
+	PyVoxelizer(const PyVoxelizer&) = delete;
+
+	~PyVoxelizer() {
+		vox_destroy(ctx);
+	}
+
+	void load_mesh(const std::string &filename, bool clean) {
+		check(vox_load_mesh(ctx, filename.c_str(), clean));
+	}
+
+	void set_mesh(py::array_t<float, py::array::c_style | py::array::forcecast> positions,
+			py::array_t<uint32_t, py::array::c_style | py::array::forcecast> faces, bool clean) {
+		if (positions.ndim() != 2 || positions.shape(1) != 3 || faces.ndim() != 2 || faces.shape(1) != 3)
+			throw py::value_error("positions and faces must have shape (n, 3)");
+		check(vox_set_mesh(ctx, positions.data(), positions.shape(0), faces.data(), faces.shape(0), clean));
+	}
+
+	void voxelize(py::object dim) {
+		int32_t d[3];
+		if (py::isinstance<py::int_>(dim)) {
+			d[0] = d[1] = d[2] = dim.cast<int32_t>();
+		} else {
+			py::tuple t = dim.cast<py::tuple>();
+			if (t.size() != 3)
+				throw py::value_error("dim must be an int or (x, y, z)");
+			for (int i = 0; i < 3; i++)
+				d[i] = t[i].cast<int32_t>();
+		}
+		int status;
+		{
+			py::gil_scoped_release release;
+			status = vox_voxelize(ctx, d);
+		}
+		check(status);
+	}
+
+	// fills out (C-contiguous, writable, of the layout's dtype and at least the required size) or a
+	// new array; coordinates come back as the first n_voxels rows of out
+	py::array read(const std::string &layout_name, py::object out) {
+		VoxLayout layout = parse_layout(layout_name);
+		int64_t n_bytes = vox_required_bytes(ctx, layout);
+		check(n_bytes < 0 ? -1 : 0);
+
+		py::array array;
+		if (out.is_none()) {
+			if (layout == VOX_DENSE)
+				array = py::array_t<uint8_t>(n_bytes);
+			else if (layout == VOX_BITSET)
+				array = py::array_t<uint64_t>(n_bytes/sizeof(uint64_t));
+			else
+				array = py::array_t<uint16_t>(n_bytes/sizeof(uint16_t));
+		} else {
+			array = out.cast<py::array>();
+			const char *dtype = layout == VOX_DENSE ? "uint8" : layout == VOX_BITSET ? "uint64" : "uint16";
+			py::ssize_t itemsize = layout == VOX_DENSE ? 1 : layout == VOX_BITSET ? 8 : 2;
+			if (array.dtype().kind() != 'u' || array.itemsize() != itemsize || !(array.flags() & py::array::c_style) || !array.writeable())
+				throw py::value_error(std::string("out must be a writable C-contiguous ") + dtype + " array");
+		}
+
+		VoxGrid grid;
+		void *buffer = array.mutable_data();
+		int64_t capacity = array.nbytes();
+		int status;
+		{
+			py::gil_scoped_release release;
+			status = vox_read(ctx, layout, buffer, capacity, &grid);
+		}
+		check(status);
+
+		// the same memory, shaped as the tensor
+		std::vector<py::ssize_t> shape(grid.tensor.shape, grid.tensor.shape + grid.tensor.ndim), strides(grid.tensor.ndim);
+		for (int i = 0; i < grid.tensor.ndim; i++)
+			strides[i] = grid.tensor.strides[i]*array.itemsize();
+		return py::array(array.dtype(), shape, strides, buffer, array);
+	}
+
+	int64_t n_voxels() {
+		int64_t n = vox_required_bytes(ctx, VOX_COORDS);
+		check(n < 0 ? -1 : 0);
+		return n/(3*sizeof(uint16_t));
+	}
+
+private:
+	void check(int status) {
+		if (status != 0)
+			throw std::runtime_error(vox_error(ctx));
+	}
+
+	VoxContext *ctx = NULL;
+};
+
+PYBIND11_MODULE(pyvoxelizer, m) {
+	using namespace pybind11::literals;
+	py::class_<PyVoxelizer>(m, "Voxelizer")
+		.def(py::init<const std::string&, const std::string&, bool>(), "backend"_a = "gl", "thickness"_a = "thin", "exact"_a = false)
+		.def("load_mesh", &PyVoxelizer::load_mesh, "filename"_a, "clean"_a = false)
+		.def("set_mesh", &PyVoxelizer::set_mesh, "positions"_a, "faces"_a, "clean"_a = false)
+		.def("voxelize", &PyVoxelizer::voxelize, "dim"_a)
+		.def("read", &PyVoxelizer::read, "layout"_a = "dense", "out"_a = py::none())
+		.def("n_voxels", &PyVoxelizer::n_voxels);
+}